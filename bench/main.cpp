@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "SyntheticFrameSource.h"
+#include "ScreenReader.h"
+#include "ScreenProcessor.h"
+#include "LedLayout.h"
+#include "LedProcessor.h"
+#include "CaptureChain.h"
+#include "WorkerPool.h"
+#include "LedFrame.h"
+#include "LedShm.h"
+#include "TemporalFilter.h"
+
+/*
+ * Headless benchmarks of every stage, from capture to the LED daemon.
+ *
+ * Each benchmark prints one JSON object per line to stdout, e.g.
+ *   {"bench":"ledprocessor.copy","width":1920,"height":1080,"leds":104,
+ *    "threads":1,"mode":"direct","iterations":8192,"ns_per_frame":1234.5,
+ *    "fps":810044.2}
+ * so results can be diffed or collected over time. All inputs are
+ * synthetic and deterministic.
+ */
+
+struct Options {
+    // Minimum time per repeat, in seconds
+    double seconds = 0.1;
+    // Repeats per benchmark; the median is reported
+    int repeats = 3;
+    // Only run benchmarks whose name contains this
+    std::string filter;
+};
+
+Options opts;
+
+// Results that must not be optimized away are written here
+volatile uint32_t benchSink;
+
+struct Params {
+    std::string bench;
+    int width = 0, height = 0;
+    size_t leds = 0;
+    int threads = 1;
+    std::string mode;
+};
+
+double nowSeconds(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/**
+ * @brief Time a frame function, and print the result.
+ */
+template<class F>
+void run(const Params &p, F frame){
+    if(!opts.filter.empty() && p.bench.find(opts.filter) == std::string::npos) return;
+
+    // Warm up, and find how many frames take long enough to time reliably
+    size_t iterations = 1;
+    while(true){
+        const double t0 = nowSeconds();
+        for(size_t i = 0; i < iterations; ++i) frame();
+        if(nowSeconds() - t0 >= opts.seconds/4 || iterations >= (size_t(1) << 30)) break;
+        iterations *= 2;
+    }
+    iterations *= 4;
+
+    std::vector<double> ns;
+    for(int r = 0; r < opts.repeats; ++r){
+        const double t0 = nowSeconds();
+        for(size_t i = 0; i < iterations; ++i) frame();
+        ns.push_back((nowSeconds() - t0) * 1e9 / iterations);
+    }
+    std::sort(ns.begin(), ns.end());
+    const double median = ns[ns.size()/2];
+
+    printf(
+        "{\"bench\":\"%s\",\"width\":%d,\"height\":%d,\"leds\":%zu,\"threads\":%d,"
+        "\"mode\":\"%s\",\"iterations\":%zu,\"ns_per_frame\":%.1f,\"fps\":%.1f}\n",
+        p.bench.c_str(), p.width, p.height, p.leds, p.threads,
+        p.mode.c_str(), iterations, median, 1e9/median
+    );
+    fflush(stdout);
+}
+
+const char *modeName(ScreenProcessor::Mode mode, bool linear = false){
+    if(linear) return (mode == ScreenProcessor::DIRECT ? "direct-linear" : "sat-linear");
+    return (mode == ScreenProcessor::DIRECT ? "direct" : "sat");
+}
+
+/**
+ * @brief Capture and reduction stages, for one resolution and layout.
+ */
+void benchScreen(int W, int H, const LedLayout &layout, bool withReader){
+    const int cellsX = layout.getCellsX(), cellsY = layout.getCellsY();
+    const std::vector<LedLayout::Slot> slots = layout.getSlots(W, H);
+    Params p;
+    p.width = W; p.height = H; p.leds = slots.size();
+
+    // Static frames cost nothing to render, so only our own work is timed
+    SyntheticFrameSource source(W, H, SyntheticFrameSource::STATIC);
+    ScreenReader reader(source, cellsX, cellsY);
+
+    if(withReader){
+        p.bench = "reader.update";
+        p.mode = "full";
+        run(p, [&](){ reader.update(); });
+
+        reader.setChangeDetection(true);
+        p.mode = "incremental";
+        run(p, [&](){ reader.update(); });
+        reader.setChangeDetection(false);
+    }
+
+    ScreenProcessor direct(reader, W/cellsX, H/cellsY, ScreenProcessor::DIRECT);
+    ScreenProcessor sat   (reader, W/cellsX, H/cellsY, ScreenProcessor::SUMMED_AREA_TABLE);
+    ScreenProcessor directLinear(reader, W/cellsX, H/cellsY, ScreenProcessor::DIRECT, true);
+    ScreenProcessor satLinear   (reader, W/cellsX, H/cellsY, ScreenProcessor::SUMMED_AREA_TABLE, true);
+    direct.update();
+    sat.update();
+    directLinear.update();
+    satLinear.update();
+
+    if(withReader){
+        p.bench = "processor.update";
+        p.mode = "sat";
+        run(p, [&](){ sat.update(); });
+        p.mode = "sat-linear";
+        run(p, [&](){ satLinear.update(); });
+    }
+
+    p.bench = "processor.getColor";
+    for(ScreenProcessor *processor: {&direct, &sat, &directLinear, &satLinear}){
+        const bool linear = (processor == &directLinear || processor == &satLinear);
+        const bool isDirect = (processor == &direct || processor == &directLinear);
+        p.mode = modeName(isDirect ? ScreenProcessor::DIRECT : ScreenProcessor::SUMMED_AREA_TABLE, linear);
+        run(p, [&](){
+            uint32_t sum = 0;
+            for(const LedLayout::Slot &slot: slots) sum += processor->getColor(slot.rect).r;
+            benchSink = sum;
+        });
+    }
+
+    p.bench = "ledprocessor.copy";
+    p.mode = "direct";
+    LedProcessor ledProcessor(direct, layout);
+    LedFrame frame(ledProcessor.getNumLeds());
+    for(int threads: {1, 2, 4}){
+        WorkerPool pool(threads);
+        ledProcessor.setPool(&pool);
+        p.threads = threads;
+        run(p, [&](){ ledProcessor.copy(frame); });
+        ledProcessor.setPool(nullptr);
+    }
+    p.threads = 1;
+
+    p.bench = "chain.update";
+    for(bool linear: {false, true}){
+        for(ScreenProcessor::Mode mode: {ScreenProcessor::DIRECT, ScreenProcessor::SUMMED_AREA_TABLE}){
+            CaptureChain::Options chainOptions;
+            chainOptions.reduction = mode;
+            chainOptions.linear = linear;
+            CaptureChain chain(new SyntheticFrameSource(W, H, SyntheticFrameSource::STATIC), layout, chainOptions);
+            p.mode = modeName(mode, linear);
+            run(p, [&](){ chain.update(frame); });
+        }
+    }
+
+    // Dense strips blended from the default 32x20 regions
+    if(layout.getCellsX() > 32){
+        for(LedProcessor::Interpolation interpolation: {LedProcessor::LINEAR, LedProcessor::CATMULL_ROM}){
+            CaptureChain::Options chainOptions;
+            chainOptions.sampling.countX = 32;
+            chainOptions.sampling.countY = 20;
+            chainOptions.sampling.interpolation = interpolation;
+            CaptureChain chain(new SyntheticFrameSource(W, H, SyntheticFrameSource::STATIC), layout, chainOptions);
+            p.mode = (interpolation == LedProcessor::LINEAR ? "direct-sampled-linear" : "direct-sampled-spline");
+            run(p, [&](){ chain.update(frame); });
+        }
+    }
+}
+
+/**
+ * @brief Stages after the colours are computed: publishing and smoothing.
+ */
+void benchLeds(size_t numLeds){
+    Params p;
+    p.leds = numLeds;
+
+    // Two frames, the second the first reversed, so that the filter has
+    // work to do when alternating between them
+    LedFrame colors(numLeds), other(numLeds);
+    for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c){
+        for(size_t i = 0; i < numLeds; ++i){
+            colors.channel(LedFrame::Channel(c))[i] = uint8_t((3*i+c)*7);
+            other.channel(LedFrame::Channel(2-c))[numLeds-1-i] = uint8_t((3*i+c)*7);
+        }
+    }
+
+    const size_t size = LedShm::getSize(numLeds, LedShm::DEFAULT_NUM_FRAMES);
+    void *shm = nullptr;
+    if(posix_memalign(&shm, 64, size) != 0) throw std::bad_alloc();
+    LedShm::Ring::init(shm, numLeds, LedShm::DEFAULT_NUM_FRAMES, LedShm::INTENSITY_MAX);
+    {
+        LedShm::Ring ring(shm, size);
+        LedShm::Timestamps timestamps = {0, 0, 0, 0};
+        p.bench = "shm.publish";
+        run(p, [&](){
+            ++timestamps.published;
+            ring.publish(colors, timestamps);
+            ring.notify();
+        });
+
+        LedFrame latest(numLeds);
+        LedShm::FrameInfo info;
+        p.bench = "shm.readLatest";
+        run(p, [&](){ ring.readLatest(latest, info); });
+    }
+    free(shm);
+
+    LedFrame out(numLeds);
+    TemporalFilter filter(numLeds, TemporalFilter::Options());
+    bool odd = false;
+    p.bench = "leds.filter";
+    run(p, [&](){
+        filter.process(odd ? other : colors, 0.02, 1.0f, out);
+        odd = !odd;
+    });
+
+    // What every sink does once per frame
+    std::vector<uint8_t> bytes(numLeds*3);
+    p.bench = "leds.interleave";
+    run(p, [&](){
+        out.interleave(bytes.data(), LedFrame::GRB);
+        benchSink = bytes[0];
+    });
+}
+
+void usage(const char *argv0){
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --filter NAME    Only run benchmarks whose name contains NAME\n"
+        "  --time SECONDS   Minimum time per repeat (default: 0.1)\n"
+        "  --repeats N      Repeats per benchmark; the median is reported\n"
+        "                   (default: 3)\n",
+        argv0
+    );
+}
+
+int main(int argc, char *argv[]){
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--help"){ usage(argv[0]); return 0; }
+        if(i+1 >= argc){ usage(argv[0]); return 1; }
+        const std::string val = argv[++i];
+        if     (arg == "--filter" ) opts.filter  = val;
+        else if(arg == "--time"   ) opts.seconds = atof(val.c_str());
+        else if(arg == "--repeats") opts.repeats = std::max(1, atoi(val.c_str()));
+        else { usage(argv[0]); return 1; }
+    }
+
+    // 104 LEDs (the default strip), and larger installations; regions
+    // must be at least 2 pixels wide, which caps 1080p at 3000 LEDs
+    const LedLayout layouts[] = {
+        LedLayout(32, 20),
+        LedLayout(300, 200),
+        LedLayout(600, 400)
+    };
+    const int resolutions[][2] = {
+        {1920, 1080},
+        {3840, 2160}
+    };
+
+    for(const auto &res: resolutions){
+        bool first = true;
+        for(const LedLayout &layout: layouts){
+            benchScreen(res[0], res[1], layout, first);
+            first = false;
+        }
+    }
+    for(const LedLayout &layout: layouts){
+        benchLeds(layout.getNumLeds());
+    }
+
+    return 0;
+}
@@ -1,8 +1,8 @@
+#include <algorithm>
 #include <deque>
 #include <fcntl.h>
 #include <iostream>
 #include <map>
-#include <semaphore.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -10,21 +10,18 @@
 #include <unistd.h>
 #include <vector>
 
+#include "LedShm.h"
+
 #define key 1
 
 using namespace std;
 
-const int NUM_LEDS_WIDTH = 32;
-const int NUM_LEDS_HEIGHT = 20;
-const int NUM_LEDS_TOTAL = 2 * (NUM_LEDS_WIDTH + NUM_LEDS_HEIGHT);
-
-const char SHM_NAME[] = "/shm_leds";
-const char SEM_NAME[] = "/sem_leds";
 const mode_t SHM_MODE = 0777;
-const off_t SHM_SIZE = NUM_LEDS_TOTAL*3 + 2;
+// Depends on the layout screenreader.app was started with
+off_t SHM_SIZE;
 
 const int INTENSITY_MIN = 0;
-const int INTENSITY_MAX = 100;
+const int INTENSITY_MAX = LedShm::INTENSITY_MAX;
 const int STEP = 10;
 
 enum Key {
@@ -37,22 +34,23 @@ const map<deque<char>, Key> CHAR_SEQUENCES = {
     {{(char)27, (char)91, (char)68}, ARROW_LEFT }
 };
 
-sem_t *sem = nullptr;
 int shm_fd;
 void *shm = nullptr;
+LedShm::Ring *ring = nullptr;
 
 int openShm(){
-    sem = sem_open(SEM_NAME, O_CREAT, 0777, 1);
-    if (sem == SEM_FAILED){
-        perror("[INTENSITY] Could not open semaphore");
+    shm_fd = shm_open(LedShm::NAME, O_RDWR, SHM_MODE);
+    if(shm_fd == -1){
+        perror("[INTENSITY] Could not open shm");
         return 1;
     }
 
-    shm_fd = shm_open(SHM_NAME, O_RDWR, SHM_MODE);
-    if(shm_fd == -1){
-        perror("[INTENSITY] Could not open shm");
+    struct stat st;
+    if(fstat(shm_fd, &st) != 0){
+        perror("[INTENSITY] Could not stat shm");
         return 1;
     }
+    SHM_SIZE = st.st_size;
 
     shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     if(shm == MAP_FAILED){
@@ -60,40 +58,35 @@ int openShm(){
         return 1;
     }
 
+    try {
+        ring = new LedShm::Ring(shm, SHM_SIZE);
+    } catch(const std::runtime_error &e){
+        fprintf(stderr, "[INTENSITY] %s\n", e.what());
+        return 1;
+    }
+
     return 0;
 }
 
+// The segment belongs to screenreader.app, so it is not unlinked here
 int closeShm(){
+    delete ring;
+    ring = nullptr;
+
     if(munmap((void*)shm, SHM_SIZE) != 0) return 1;
 
     if(close(shm_fd) != 0) return 1;
 
-    if(shm_unlink(SHM_NAME) != 0) return 1;
-
-    if (sem_destroy(sem) != 0) return 1;
-
-    if (sem_unlink(SEM_NAME) != 0) return 1;
-
     return 0;
 }
 
 void changeIntensity(int delta){
-    sem_wait(sem);
-
-    uint16_t *intensity = (uint16_t*)((uint8_t*)(shm)+NUM_LEDS_TOTAL*3);
-    int intensity_int = *intensity;
-
-    if(intensity_int + delta < INTENSITY_MIN){
-        *intensity = INTENSITY_MIN;
-    } else if(intensity_int + delta > INTENSITY_MAX){
-        *intensity = INTENSITY_MAX;
-    } else {
-        *intensity += delta;
-    }
-
-    int intensity_final = *intensity;
+    std::atomic<uint16_t> &intensity = ring->intensity();
 
-    sem_post(sem);
+    uint16_t intensity_old = intensity.load(), intensity_final;
+    do {
+        intensity_final = uint16_t(max(INTENSITY_MIN, min(INTENSITY_MAX, intensity_old + delta)));
+    } while(!intensity.compare_exchange_weak(intensity_old, intensity_final));
 
     cout << " Changed intensity to " << intensity_final << endl;
 }
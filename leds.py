@@ -1,18 +1,17 @@
 #!/usr/bin/env python3
 
 import time
-from multiprocessing import shared_memory
-import posix_ipc
+from multiprocessing import resource_tracker, shared_memory
+import ctypes
 import math
+import platform
+import struct
 
 from rpi_ws281x import Color, PixelStrip
 
-# Parametrizable LED strip configuration:
-NUM_LEDS_WIDTH = 32
-NUM_LEDS_HEIGHT = 20
-
 # LED strip configuration:
-LED_COUNT = 2*(NUM_LEDS_WIDTH + NUM_LEDS_HEIGHT) # Number of LED pixels.
+# The number of LEDs is taken from the shared memory segment, and depends on
+# the layout screenreader.app was started with
 LED_PIN = 18          # GPIO pin connected to the pixels (18 uses PWM!).
 LED_FREQ_HZ = 800000  # LED signal frequency in hertz (usually 800khz)
 LED_DMA = 10          # DMA channel to use for generating signal (try 10)
@@ -33,6 +32,99 @@ def colorWipe(strip, color, wait_ms=50):
 def colorFromHex(hex : str, intensity : int) -> Color:
     return Color(*tuple(int(int(hex[i:i+2], 16) * intensity) for i in (0, 2, 4)))
 
+# Layout of the /shm_leds segment; see screenreader/include/LedShm.h
+SHM_MAGIC = 0x5344454c
+SHM_VERSION = 3
+SHM_HEADER = struct.Struct('<IHHIIII') # magic, version, headerSize, numLeds, numFrames, frameSize, frameHeaderSize
+SHM_INTENSITY = struct.Struct('<H')
+SHM_INTENSITY_OFFSET = 24
+SHM_PUBLISHED = struct.Struct('<I')
+SHM_PUBLISHED_OFFSET = 32
+SHM_FEEDBACK_SEQ_OFFSET = 36
+SHM_FEEDBACK = struct.Struct('<QQQ') # number, received, output
+SHM_FEEDBACK_OFFSET = 40
+SHM_FRAME_SEQ = struct.Struct('<I')
+SHM_FRAME_NUMBER = struct.Struct('<Q')
+SHM_FRAME_NUMBER_OFFSET = 8
+
+# The published counter is a futex the producer wakes after every frame
+SYS_FUTEX = {'x86_64': 202, 'i686': 240, 'armv6l': 240, 'armv7l': 240, 'aarch64': 98}.get(platform.machine())
+FUTEX_WAIT = 0
+POLL_INTERVAL = 0.005
+
+class Timespec(ctypes.Structure):
+    _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+class LedRing:
+    """Lock-free reader of the frame ring in /shm_leds."""
+    def __init__(self, buf):
+        self.buf = buf
+        magic, version, self.headerSize, self.numLeds, self.numFrames, self.frameSize, self.frameHeaderSize = SHM_HEADER.unpack_from(buf, 0)
+        if magic != SHM_MAGIC or version != SHM_VERSION:
+            raise RuntimeError('Shared memory is not a compatible LED frame ring')
+        self.libc = ctypes.CDLL(None, use_errno=True)
+        self.futex = ctypes.c_uint32.from_buffer(buf, SHM_PUBLISHED_OFFSET)
+        self.feedbackSeq = ctypes.c_uint32.from_buffer(buf, SHM_FEEDBACK_SEQ_OFFSET)
+
+    def close(self):
+        # Release the references to the buffer, so the segment can be closed
+        del self.futex
+        del self.feedbackSeq
+
+    def waitForFrame(self, seen, timeout):
+        """Sleeps until the published counter differs from seen, or timeout seconds pass; returns the counter."""
+        published = self.published()
+        if published != seen:
+            return published
+        if SYS_FUTEX is None:
+            time.sleep(POLL_INTERVAL)
+        else:
+            ts = Timespec(int(timeout), int((timeout % 1) * 1e9))
+            self.libc.syscall(SYS_FUTEX, ctypes.byref(self.futex), FUTEX_WAIT, ctypes.c_uint32(seen), ctypes.byref(ts), None, 0)
+        return self.published()
+
+    def intensity(self):
+        return SHM_INTENSITY.unpack_from(self.buf, SHM_INTENSITY_OFFSET)[0]
+
+    def published(self):
+        return SHM_PUBLISHED.unpack_from(self.buf, SHM_PUBLISHED_OFFSET)[0]
+
+    def readLatest(self):
+        """Returns (frame number, colour bytes) of the latest frame, or None if there is none yet.
+
+        The colours are planar: the red value of every LED, then the green ones, then the blue ones."""
+        while True:
+            published = self.published()
+            if published == 0:
+                return None
+            index = published-1
+            offset = self.headerSize + (index % self.numFrames) * self.frameSize
+            seq = SHM_FRAME_SEQ.unpack_from(self.buf, offset)[0]
+            if seq & 1:
+                continue
+            number = SHM_FRAME_NUMBER.unpack_from(self.buf, offset + SHM_FRAME_NUMBER_OFFSET)[0]
+            data = bytes(self.buf[offset + self.frameHeaderSize : offset + self.frameHeaderSize + 3*self.numLeds])
+            # Retry if the writer touched the frame while it was being copied
+            if SHM_FRAME_SEQ.unpack_from(self.buf, offset)[0] == seq and (number & 0xffffffff) == index:
+                return number, data
+
+    def report(self, number, received, output):
+        """Reports that frame number was read at received and sent to the LEDs at output, in CLOCK_MONOTONIC nanoseconds; returns True if the report was written.
+
+        Python has no compare-and-swap, so this assumes it is the only consumer reporting, and
+        cannot order its stores on weakly ordered CPUs: screenreader.app may rarely read a torn
+        report, which only skews its latency statistics."""
+        seq = self.feedbackSeq.value
+        if seq & 1:
+            return False
+        self.feedbackSeq.value = seq+1
+        SHM_FEEDBACK.pack_into(self.buf, SHM_FEEDBACK_OFFSET, number, received, output)
+        # screenreader.app resets the sequence if a report takes too long; do not undo that
+        if self.feedbackSeq.value != seq+1:
+            return False
+        self.feedbackSeq.value = seq+2
+        return True
+
 def getWeight():
     nowTime = time.time()
     delta = nowTime-getWeight.prevTime
@@ -46,11 +138,14 @@ def main():
 
     # Hardcoded
     shm_name = "/shm_leds"
-    sem_name = "/sem_leds"
     
-    # Initialize shared memory & semaphore
+    # Initialize shared memory
     shm = shared_memory.SharedMemory(shm_name, create=False)
-    sem = posix_ipc.Semaphore(sem_name)
+    # The segment belongs to screenreader.app; do not let Python unlink it on exit
+    resource_tracker.unregister(shm._name, 'shared_memory')
+    ring = LedRing(shm.buf)
+
+    LED_COUNT = ring.numLeds
 
     # Create NeoPixel object with appropriate configuration.
     if USE_LEDS:
@@ -61,14 +156,23 @@ def main():
     colors    = [(0,0,0) for _ in range(LED_COUNT)]
     shmColors = [(0,0,0) for _ in range(LED_COUNT)]
 
+    published = 0
     try:
         while True:
-            sem.acquire()
-            intensity = shm.buf[LED_COUNT*3] / 100
+            # Sleep until screenreader.app publishes a new frame
+            newPublished = ring.waitForFrame(published, 1.0)
+            if newPublished == published:
+                continue
+            published = newPublished
 
-            for i in range(LED_COUNT):
-                shmColors[i] = tuple(bytes(shm.buf[3*i:3*i+3]))
-            sem.release()
+            intensity = ring.intensity() / 100
+
+            frame = ring.readLatest()
+            received = time.monotonic_ns()
+            if frame is not None:
+                data = frame[1]
+                for i in range(LED_COUNT):
+                    shmColors[i] = (data[i], data[LED_COUNT+i], data[2*LED_COUNT+i])
 
             w = getWeight()
             for i in range(LED_COUNT):
@@ -87,6 +191,8 @@ def main():
                     )
                     strip.setPixelColor(index, c)
                 strip.show()
+                if frame is not None:
+                    ring.report(frame[0], received, time.monotonic_ns())
             else:
                 print(colors)
 
@@ -94,8 +200,8 @@ def main():
 
     except KeyboardInterrupt:
         colorWipe(strip, Color(0, 0, 0), 1)
+        ring.close()
         shm.close()
-        sem.close()
         
 
 if __name__ == '__main__':
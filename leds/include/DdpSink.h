@@ -0,0 +1,104 @@
+#pragma once
+
+#include "LedSink.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sink that sends frames over UDP with the Distributed Display
+ * Protocol, to a networked controller such as an ESP32 running WLED.
+ *
+ * Each packet carries a 10-byte header and up to MAX_LEDS_PER_PACKET RGB
+ * values at an offset into the strip; the last packet of a frame has the
+ * PUSH flag, which makes the controller show it. All the packets of a frame
+ * are sent with one system call.
+ *
+ * Most frames are deltas: only the spans of LEDs that differ from what was
+ * last sent, with short runs of unchanged LEDs in between included when that
+ * is cheaper than another packet. A keyframe with every LED is sent every
+ * keyframeInterval seconds, so that a controller that lost packets or was
+ * restarted catches up, and so that it does not time out while the screen
+ * is still.
+ *
+ * A token bucket keeps output under maxBytesPerSecond, counting IP and UDP
+ * headers: a frame that does not fit is skipped, and its changes go out
+ * with the next frame that does. Frames are otherwise sent as they are
+ * written, i.e. at the rate screenreader.app publishes them.
+ */
+class DdpSink : public LedSink {
+public:
+    struct Options {
+        /// Seconds between keyframes
+        double keyframeInterval = 1;
+        /// Budget in bytes per second, or 0 for none
+        double maxBytesPerSecond = 0;
+        /// Byte order the controller expects; WLED takes RGB and reorders
+        /// for its LEDs itself
+        LedFrame::Order order = LedFrame::RGB;
+    };
+
+    static const uint16_t DEFAULT_PORT = 4048;
+    static const size_t HEADER_SIZE = 10;
+    /// WLED's limit, which keeps packets within an Ethernet MTU
+    static const size_t MAX_LEDS_PER_PACKET = 480;
+    /// IPv4 and UDP headers
+    static const size_t OVERHEAD_BYTES = 28;
+
+    struct Stats {
+        uint64_t frames;
+        uint64_t keyframes;
+        /// Frames skipped for lack of budget
+        uint64_t skipped;
+        uint64_t packets;
+        uint64_t bytes;
+    };
+
+private:
+    struct Span {
+        size_t first, count;
+    };
+
+    int fd;
+    std::string target;
+    Options options;
+
+    /// Colours of the frame being written, and those the controller was
+    /// last sent, interleaved in the controller's order
+    std::vector<uint8_t> colors;
+    std::vector<uint8_t> sent;
+    std::vector<Span> spans;
+    std::vector<uint8_t> headers;
+
+    bool keyframeDue;
+    uint64_t lastKeyframe;
+    uint8_t sequence;
+
+    double tokens;
+    uint64_t lastRefill;
+
+    Stats stats;
+
+    void findChanges(const uint8_t *rgb, size_t numLeds);
+    size_t getCost() const;
+    void refill(uint64_t now, size_t frameCost);
+    bool send(const uint8_t *rgb);
+
+public:
+    /**
+     * @brief Construct a new Ddp Sink object
+     *
+     * @param address   HOST or HOST:PORT of the controller
+     * @param options_  Keyframe interval and bandwidth budget
+     * @throws std::invalid_argument if the address cannot be resolved
+     * @throws std::system_error if the socket cannot be created
+     */
+    DdpSink(const std::string &address, const Options &options_);
+
+    virtual void write(const LedFrame &frame);
+
+    Stats getStats() const;
+
+    virtual ~DdpSink();
+};
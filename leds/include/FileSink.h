@@ -0,0 +1,22 @@
+#pragma once
+
+#include "LedSink.h"
+
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Sink that writes each frame as a line of RRGGBB hex values, for
+ * testing. The path "-" writes to stdout.
+ */
+class FileSink : public LedSink {
+private:
+    FILE *file;
+
+public:
+    FileSink(const std::string &path);
+
+    virtual void write(const LedFrame &colors);
+
+    virtual ~FileSink();
+};
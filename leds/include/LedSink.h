@@ -0,0 +1,21 @@
+#pragma once
+
+#include "LedFrame.h"
+
+/**
+ * @brief Destination of LED colours, e.g. a physical strip.
+ */
+class LedSink {
+public:
+    /**
+     * @brief Output one frame.
+     *
+     * Sinks interleave the planes of the frame in the byte order of their
+     * device; no stage before them does.
+     *
+     * @param colors    Colour of every LED, in strip order
+     */
+    virtual void write(const LedFrame &colors) = 0;
+
+    virtual ~LedSink(){}
+};
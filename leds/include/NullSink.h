@@ -0,0 +1,12 @@
+#pragma once
+
+#include "LedSink.h"
+
+/**
+ * @brief Sink that discards every frame; useful to profile the pipeline
+ * without any output device.
+ */
+class NullSink : public LedSink {
+public:
+    virtual void write(const LedFrame &colors){}
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "LedSink.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sink that drives a WS281x strip from an SPI MOSI pin, through spidev.
+ *
+ * Each bit of colour is sent as three SPI bits at 2.4 MHz (1 -> 110,
+ * 0 -> 100), which yields the 0.4/0.8 us pulses WS281x LEDs expect. Colours
+ * are sent in GRB order unless told otherwise, followed by a low period that
+ * latches the frame.
+ *
+ * On a Raspberry Pi, use /dev/spidev0.0 (MOSI on GPIO 10). Frames larger
+ * than 4096 bytes (about 440 LEDs) need spidev.bufsiz raised in
+ * /boot/cmdline.txt.
+ */
+class SpiSink : public LedSink {
+private:
+    static const uint32_t SPEED_HZ = 2400000;
+    /// Zero bytes sent after each frame; at 2.4 MHz, 90 bytes are 300 us,
+    /// enough for WS2812B LEDs, which latch after more than 280 us low
+    static const size_t RESET_BYTES = 90;
+
+    int fd;
+    LedFrame::Order order;
+    std::vector<uint8_t> buffer;
+
+public:
+    /**
+     * @brief Construct a new Spi Sink object
+     *
+     * @param device    spidev device, e.g. /dev/spidev0.0
+     * @param order_    Byte order of the colours of the LEDs
+     * @throws std::system_error if the device cannot be opened or configured
+     */
+    SpiSink(const std::string &device, LedFrame::Order order_ = LedFrame::GRB);
+
+    virtual void write(const LedFrame &colors);
+
+    virtual ~SpiSink();
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "LedFrame.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Motion-adaptive exponential smoothing of LED colours, in
+ * fixed-point SIMD.
+ *
+ * Every frame, each LED moves from its current colour towards the new
+ * target by a weight w in [0, 1]. The base weight comes from the time since
+ * the previous frame, w = 1-exp(-dt/decay), as in leds.py. On top of that,
+ * an LED whose target differs from its current colour by more than
+ * cutThreshold levels (in any channel) gets a boost that grows linearly and
+ * reaches w = 1 at cutThreshold+cutRange levels: scene cuts show up at once,
+ * while static content and noise are heavily smoothed.
+ *
+ * State is kept as planar R, G and B arrays of 16-bit values with 6
+ * fractional bits, and weights are Q15, so a whole frame is filtered 8 LEDs
+ * at a time (SSE2 on x86, NEON on ARM).
+ */
+class TemporalFilter {
+public:
+    struct Options {
+        /// Time constant of the exponential decay, in seconds
+        double decay = 0.05;
+        /// Difference, in levels (0-255), below which only the base
+        /// smoothing applies
+        int cutThreshold = 24;
+        /// Levels above cutThreshold at which the LED jumps to its target
+        int cutRange = 64;
+    };
+
+private:
+    static const int FRACTION_BITS = 6;
+    static const int LANES = 8;
+
+    Options options;
+    size_t numLeds;
+    size_t paddedLeds;
+
+    // Planar buffers: R, G and B, each paddedLeds long
+    std::vector<int16_t> state;
+    std::vector<int16_t> target;
+
+    bool first;
+
+public:
+    TemporalFilter(size_t numLeds_, const Options &options_);
+
+    /**
+     * @brief Filter one frame.
+     *
+     * @param colors        Target colours of at least numLeds LEDs
+     * @param dt            Seconds since the previous frame
+     * @param intensity     Output scale, 0 to 1
+     * @param dest          Filtered colours, for at least numLeds LEDs; the
+     *                      padding of its planes may be overwritten
+     */
+    void process(const LedFrame &colors, double dt, float intensity, LedFrame &dest);
+};
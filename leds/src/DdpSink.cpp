@@ -0,0 +1,232 @@
+#include "DdpSink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+const uint8_t FLAG_VERSION_1 = 0x40;
+const uint8_t FLAG_PUSH      = 0x01;
+/// RGB, 8 bits per channel
+const uint8_t TYPE_RGB24     = 0x0b;
+/// Default output device of the controller
+const uint8_t DEST_DEFAULT   = 0x01;
+
+/// Unchanged LEDs cheaper to resend than to start another packet for
+const size_t MAX_GAP = (DdpSink::HEADER_SIZE + DdpSink::OVERHEAD_BYTES) / 3;
+
+/// Burst the bucket allows beyond one keyframe
+const double BURST_SECONDS = 0.1;
+
+uint64_t monotonicNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+// Errors after which the next frames may get through, e.g. while no
+// receiver is listening or Wi-Fi reconnects
+bool isTransient(int err){
+    return err == ECONNREFUSED || err == EHOSTUNREACH || err == ENETUNREACH ||
+           err == ENETDOWN || err == ENOBUFS || err == EAGAIN;
+}
+
+size_t getPacketCost(size_t numLeds){
+    return DdpSink::OVERHEAD_BYTES + DdpSink::HEADER_SIZE + numLeds*3;
+}
+}
+
+DdpSink::DdpSink(const std::string &address, const Options &options_):
+    fd(-1),
+    target(address),
+    options(options_),
+    keyframeDue(true),
+    lastKeyframe(0),
+    sequence(0),
+    tokens(0),
+    lastRefill(0),
+    stats()
+{
+    // HOST or HOST:PORT; an address with several colons is an IPv6 host
+    std::string host = address, port = std::to_string(DEFAULT_PORT);
+    const size_t colon = address.find(':');
+    if(colon != std::string::npos && address.find(':', colon+1) == std::string::npos){
+        host = address.substr(0, colon);
+        port = address.substr(colon+1);
+    }
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *info = nullptr;
+    const int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+    if(err != 0) throw std::invalid_argument("Could not resolve " + address + ": " + gai_strerror(err));
+
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if(fd == -1 || connect(fd, info->ai_addr, info->ai_addrlen) != 0){
+        std::error_code ec(errno, std::system_category());
+        freeaddrinfo(info);
+        if(fd != -1) close(fd);
+        throw std::system_error(ec, "Could not open a socket to " + address);
+    }
+    freeaddrinfo(info);
+}
+
+void DdpSink::findChanges(const uint8_t *rgb, size_t numLeds){
+    spans.clear();
+
+    if(keyframeDue){
+        if(numLeds > 0) spans.push_back(Span{0, numLeds});
+    } else {
+        // Runs of changed LEDs, merged across gaps of up to MAX_GAP
+        size_t i = 0;
+        while(i < numLeds){
+            if(memcmp(rgb + 3*i, sent.data() + 3*i, 3) == 0){ ++i; continue; }
+
+            size_t end = i + 1, gap = 0;
+            for(size_t j = end; j < numLeds && gap <= MAX_GAP; ++j){
+                if(memcmp(rgb + 3*j, sent.data() + 3*j, 3) == 0){
+                    ++gap;
+                } else {
+                    end = j + 1;
+                    gap = 0;
+                }
+            }
+            spans.push_back(Span{i, end - i});
+            i = end;
+        }
+    }
+
+    // Split spans to fit packets
+    std::vector<Span> split;
+    for(const Span &span: spans){
+        for(size_t first = 0; first < span.count; first += MAX_LEDS_PER_PACKET)
+            split.push_back(Span{span.first + first, std::min(MAX_LEDS_PER_PACKET, span.count - first)});
+    }
+    spans.swap(split);
+}
+
+size_t DdpSink::getCost() const {
+    size_t cost = 0;
+    for(const Span &span: spans) cost += getPacketCost(span.count);
+    return cost;
+}
+
+void DdpSink::refill(uint64_t now, size_t frameCost){
+    // The bucket holds at least a keyframe, so that keyframes get through
+    // however tight the budget
+    const size_t numLeds = sent.size() / 3;
+    const size_t numPackets = (numLeds + MAX_LEDS_PER_PACKET - 1) / MAX_LEDS_PER_PACKET;
+    const double keyframeCost = double(numPackets) * getPacketCost(0) + numLeds*3;
+    const double capacity = std::max(options.maxBytesPerSecond * BURST_SECONDS, std::max(keyframeCost, double(frameCost)));
+
+    tokens = std::min(capacity, tokens + (now - lastRefill) * 1e-9 * options.maxBytesPerSecond);
+    lastRefill = now;
+}
+
+bool DdpSink::send(const uint8_t *rgb){
+    sequence = sequence % 15 + 1;
+
+    headers.resize(spans.size() * HEADER_SIZE);
+    std::vector<iovec> iov(spans.size() * 2);
+    std::vector<mmsghdr> msgs(spans.size());
+    for(size_t i = 0; i < spans.size(); ++i){
+        const Span &span = spans[i];
+        const uint32_t offset = span.first * 3;
+        const uint16_t length = span.count * 3;
+
+        uint8_t *h = headers.data() + i*HEADER_SIZE;
+        h[0] = FLAG_VERSION_1 | (i+1 == spans.size() ? FLAG_PUSH : 0);
+        h[1] = sequence;
+        h[2] = TYPE_RGB24;
+        h[3] = DEST_DEFAULT;
+        h[4] = offset >> 24; h[5] = offset >> 16; h[6] = offset >> 8; h[7] = offset;
+        h[8] = length >> 8; h[9] = length;
+
+        iov[2*i  ].iov_base = h;
+        iov[2*i  ].iov_len  = HEADER_SIZE;
+        iov[2*i+1].iov_base = const_cast<uint8_t*>(rgb + offset);
+        iov[2*i+1].iov_len  = length;
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov    = &iov[2*i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    size_t done = 0;
+    while(done < msgs.size()){
+        const int n = sendmmsg(fd, msgs.data() + done, msgs.size() - done, 0);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            if(isTransient(errno)) return false;
+            throw std::system_error(
+                std::error_code(errno, std::system_category()),
+                "Could not send to " + target
+            );
+        }
+        done += n;
+    }
+    return true;
+}
+
+void DdpSink::write(const LedFrame &frame){
+    const uint64_t now = monotonicNanos();
+    ++stats.frames;
+
+    const size_t numLeds = frame.getNumLeds();
+    colors.resize(numLeds*3);
+    frame.interleave(colors.data(), options.order);
+    const uint8_t *rgb = colors.data();
+
+    if(sent.size() != numLeds*3){
+        sent.assign(numLeds*3, 0);
+        keyframeDue = true;
+    }
+    if(now - lastKeyframe >= uint64_t(options.keyframeInterval * 1e9)) keyframeDue = true;
+
+    findChanges(rgb, numLeds);
+    if(spans.empty()) return;
+
+    const size_t cost = getCost();
+    if(options.maxBytesPerSecond > 0){
+        refill(now, cost);
+        if(tokens < cost){
+            ++stats.skipped;
+            return;
+        }
+        tokens -= cost;
+    }
+
+    if(!send(rgb)){
+        // Some packets may have been lost; start over from a keyframe
+        keyframeDue = true;
+        return;
+    }
+
+    for(const Span &span: spans)
+        std::copy(rgb + span.first*3, rgb + (span.first + span.count)*3, sent.begin() + span.first*3);
+
+    stats.packets += spans.size();
+    stats.bytes += cost;
+    if(keyframeDue){
+        ++stats.keyframes;
+        keyframeDue = false;
+        lastKeyframe = now;
+    }
+}
+
+DdpSink::Stats DdpSink::getStats() const {
+    return stats;
+}
+
+DdpSink::~DdpSink(){
+    close(fd);
+}
@@ -0,0 +1,33 @@
+#include "FileSink.h"
+
+#include <cerrno>
+#include <system_error>
+
+FileSink::FileSink(const std::string &path){
+    if(path == "-"){
+        file = stdout;
+    } else {
+        file = fopen(path.c_str(), "w");
+        if(file == NULL){
+            throw std::system_error(
+                std::error_code(errno, std::system_category()),
+                "Could not open " + path
+            );
+        }
+    }
+}
+
+void FileSink::write(const LedFrame &colors){
+    const uint8_t *r = colors.channel(LedFrame::R);
+    const uint8_t *g = colors.channel(LedFrame::G);
+    const uint8_t *b = colors.channel(LedFrame::B);
+    for(size_t i = 0; i < colors.getNumLeds(); ++i){
+        fprintf(file, "%02x%02x%02x ", r[i], g[i], b[i]);
+    }
+    fprintf(file, "\n");
+    fflush(file);
+}
+
+FileSink::~FileSink(){
+    if(file != stdout) fclose(file);
+}
@@ -0,0 +1,77 @@
+#include "SpiSink.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+// Expand each bit of a byte to 3 bits (1 -> 110, 0 -> 100)
+// and write the resulting 24 bits as 3 bytes
+void encode(uint8_t byte, uint8_t *out){
+    uint32_t bits = 0;
+    for(int i = 7; i >= 0; --i){
+        bits = (bits << 3) | ((byte >> i) & 1 ? 0b110 : 0b100);
+    }
+    out[0] = (bits >> 16) & 0xFF;
+    out[1] = (bits >>  8) & 0xFF;
+    out[2] = (bits      ) & 0xFF;
+}
+}
+
+SpiSink::SpiSink(const std::string &device, LedFrame::Order order_):
+    order(order_)
+{
+    fd = open(device.c_str(), O_RDWR);
+    if(fd == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not open " + device
+        );
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    uint32_t speed = SPEED_HZ;
+    if(
+        ioctl(fd, SPI_IOC_WR_MODE, &mode) == -1 ||
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) == -1 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) == -1
+    ){
+        std::error_code ec(errno, std::system_category());
+        close(fd);
+        throw std::system_error(ec, "Could not configure " + device);
+    }
+}
+
+void SpiSink::write(const LedFrame &colors){
+    const size_t numLeds = colors.getNumLeds();
+    buffer.assign(numLeds*9 + RESET_BYTES, 0);
+    // Each channel goes to every 9th byte, at its position in the order
+    for(int p = 0; p < LedFrame::NUM_CHANNELS; ++p){
+        const uint8_t *in = colors.channel(LedFrame::getChannel(order, p));
+        uint8_t *out = buffer.data() + 3*p;
+        for(size_t i = 0; i < numLeds; ++i, out += 9) encode(in[i], out);
+    }
+
+    spi_ioc_transfer transfer;
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.tx_buf = (unsigned long)buffer.data();
+    transfer.len = buffer.size();
+    transfer.speed_hz = SPEED_HZ;
+    transfer.bits_per_word = 8;
+
+    if(ioctl(fd, SPI_IOC_MESSAGE(1), &transfer) == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not write to SPI device"
+        );
+    }
+}
+
+SpiSink::~SpiSink(){
+    close(fd);
+}
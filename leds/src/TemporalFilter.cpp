@@ -0,0 +1,185 @@
+#include "TemporalFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+/**
+ * @brief Filter n LEDs (n a multiple of 8) of planar state towards target.
+ *
+ * Each step is d*w rounded away from zero, so it is at least one unit
+ * (1/64 level) and never overshoots: the state settles exactly on the
+ * target instead of stalling just below it.
+ *
+ * @param wb        Base weight, Q15
+ * @param slope     Extra weight per level of difference above the threshold, Q15
+ * @param scale     Output scale, Q15, up to 32768 for 1
+ */
+void filter(
+    int16_t *sR, int16_t *sG, int16_t *sB,
+    const int16_t *tR, const int16_t *tG, const int16_t *tB,
+    uint8_t *oR, uint8_t *oG, uint8_t *oB,
+    size_t n, int16_t wb, int16_t threshold, int16_t range, int16_t slope, uint16_t scale
+){
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vwb = _mm_set1_epi16(wb);
+    const __m128i vthreshold = _mm_set1_epi16(threshold);
+    const __m128i vrange = _mm_set1_epi16(range);
+    const __m128i vslope = _mm_set1_epi16(slope);
+    const __m128i vscale = _mm_set1_epi16(scale);
+    for(size_t i = 0; i < n; i += 8){
+        __m128i s[3] = {
+            _mm_loadu_si128((const __m128i*)(sR+i)),
+            _mm_loadu_si128((const __m128i*)(sG+i)),
+            _mm_loadu_si128((const __m128i*)(sB+i))
+        };
+        const __m128i d[3] = {
+            _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tR+i)), s[0]),
+            _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tG+i)), s[1]),
+            _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(tB+i)), s[2])
+        };
+        // Largest absolute difference across channels, in levels
+        __m128i a[3];
+        __m128i diff = zero;
+        for(int c = 0; c < 3; ++c){
+            a[c] = _mm_max_epi16(d[c], _mm_sub_epi16(zero, d[c]));
+            diff = _mm_max_epi16(diff, _mm_srai_epi16(a[c], 6));
+        }
+        const __m128i excess = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(diff, vthreshold), zero), vrange);
+        const __m128i w = _mm_adds_epi16(vwb, _mm_mullo_epi16(excess, vslope));
+
+        uint8_t *o[3] = {oR+i, oG+i, oB+i};
+        for(int c = 0; c < 3; ++c){
+            // |step| = |d|*w/2^15 + 1 if d != 0, with the sign of d
+            __m128i m = _mm_mulhi_epi16(_mm_add_epi16(a[c], a[c]), w);
+            m = _mm_sub_epi16(m, _mm_cmpgt_epi16(a[c], zero));
+            const __m128i sign = _mm_srai_epi16(d[c], 15);
+            s[c] = _mm_add_epi16(s[c], _mm_sub_epi16(_mm_xor_si128(m, sign), sign));
+            // out = s/2^6 * scale/2^15
+            __m128i v = _mm_srli_epi16(_mm_mulhi_epu16(_mm_slli_epi16(s[c], 2), vscale), 7);
+            _mm_storel_epi64((__m128i*)o[c], _mm_packus_epi16(v, zero));
+        }
+        _mm_storeu_si128((__m128i*)(sR+i), s[0]);
+        _mm_storeu_si128((__m128i*)(sG+i), s[1]);
+        _mm_storeu_si128((__m128i*)(sB+i), s[2]);
+    }
+#elif defined(__ARM_NEON)
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t vwb = vdupq_n_s16(wb);
+    const int16x8_t vthreshold = vdupq_n_s16(threshold);
+    const int16x8_t vrange = vdupq_n_s16(range);
+    const int16x8_t vslope = vdupq_n_s16(slope);
+    const uint16x4_t vscale = vdup_n_u16(scale);
+    for(size_t i = 0; i < n; i += 8){
+        int16x8_t s[3] = { vld1q_s16(sR+i), vld1q_s16(sG+i), vld1q_s16(sB+i) };
+        const int16x8_t d[3] = {
+            vsubq_s16(vld1q_s16(tR+i), s[0]),
+            vsubq_s16(vld1q_s16(tG+i), s[1]),
+            vsubq_s16(vld1q_s16(tB+i), s[2])
+        };
+        int16x8_t a[3];
+        int16x8_t diff = zero;
+        for(int c = 0; c < 3; ++c){
+            a[c] = vabsq_s16(d[c]);
+            diff = vmaxq_s16(diff, vshrq_n_s16(a[c], 6));
+        }
+        const int16x8_t excess = vminq_s16(vmaxq_s16(vsubq_s16(diff, vthreshold), zero), vrange);
+        const int16x8_t w = vqaddq_s16(vwb, vmulq_s16(excess, vslope));
+
+        uint8_t *o[3] = {oR+i, oG+i, oB+i};
+        for(int c = 0; c < 3; ++c){
+            // vqdmulh computes (2*|d|*w) >> 16, i.e. |d|*w/2^15; add 1 if
+            // d != 0, and give it the sign of d
+            int16x8_t m = vqdmulhq_s16(a[c], w);
+            m = vsubq_s16(m, vreinterpretq_s16_u16(vcgtq_s16(a[c], zero)));
+            const int16x8_t sign = vshrq_n_s16(d[c], 15);
+            s[c] = vaddq_s16(s[c], vsubq_s16(veorq_s16(m, sign), sign));
+            const uint16x8_t s4 = vshlq_n_u16(vreinterpretq_u16_s16(s[c]), 2);
+            const uint16x8_t v = vcombine_u16(
+                vshrn_n_u32(vmull_u16(vget_low_u16 (s4), vscale), 16),
+                vshrn_n_u32(vmull_u16(vget_high_u16(s4), vscale), 16)
+            );
+            vst1_u8(o[c], vqmovn_u16(vshrq_n_u16(v, 7)));
+        }
+        vst1q_s16(sR+i, s[0]);
+        vst1q_s16(sG+i, s[1]);
+        vst1q_s16(sB+i, s[2]);
+    }
+#else
+    int16_t *s[3] = {sR, sG, sB};
+    const int16_t *t[3] = {tR, tG, tB};
+    uint8_t *o[3] = {oR, oG, oB};
+    for(size_t i = 0; i < n; ++i){
+        int16_t d[3];
+        int16_t diff = 0;
+        for(int c = 0; c < 3; ++c){
+            d[c] = t[c][i] - s[c][i];
+            diff = std::max<int16_t>(diff, std::abs(d[c]) >> 6);
+        }
+        const int16_t excess = std::min<int16_t>(std::max(diff - threshold, 0), range);
+        const int16_t w = int16_t(std::min(32767, wb + excess*slope));
+        for(int c = 0; c < 3; ++c){
+            const int16_t a = int16_t(std::abs(d[c]));
+            const int16_t m = int16_t(((int32_t(2*a) * w) >> 16) + (a > 0));
+            s[c][i] += (d[c] < 0 ? -m : m);
+            o[c][i] = uint8_t((((uint32_t(uint16_t(s[c][i] << 2)) * scale) >> 16) >> 7));
+        }
+    }
+#endif
+}
+}
+
+TemporalFilter::TemporalFilter(size_t numLeds_, const Options &options_):
+    options(options_),
+    numLeds(numLeds_),
+    paddedLeds((numLeds_ + LANES-1) / LANES * LANES),
+    state (3*paddedLeds, 0),
+    target(3*paddedLeds, 0),
+    first(true)
+{
+    if(options.cutThreshold < 0 || options.cutThreshold > 255)
+        throw std::invalid_argument("cutThreshold must be between 0 and 255");
+    if(options.cutRange < 1 || options.cutRange > 255)
+        throw std::invalid_argument("cutRange must be between 1 and 255");
+}
+
+void TemporalFilter::process(const LedFrame &colors, double dt, float intensity, LedFrame &dest){
+    if(dest.getNumLeds() < numLeds) throw std::invalid_argument("The destination frame has too few LEDs");
+
+    int16_t *tR = target.data(), *tG = tR + paddedLeds, *tB = tG + paddedLeds;
+    int16_t *t[3] = {tR, tG, tB};
+    for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c){
+        const uint8_t *in = colors.channel(LedFrame::Channel(c));
+        for(size_t i = 0; i < numLeds; ++i) t[c][i] = int16_t(in[i] << FRACTION_BITS);
+    }
+
+    // Start from the first frame rather than fading in from black
+    if(first){
+        state = target;
+        first = false;
+    }
+
+    const double w = (options.decay > 0 ? 1.0 - std::exp(-dt/options.decay) : 1.0);
+    const int16_t wb = int16_t(std::min(32767.0, std::max(0.0, w*32767.0)));
+    const int16_t slope = int16_t(32767 / options.cutRange);
+    // Q15 rather than Q16, so that full intensity (32768) is exact
+    const uint16_t scale = uint16_t(std::lround(std::min(1.0f, std::max(0.0f, intensity)) * 32768.0f));
+
+    int16_t *sR = state.data(), *sG = sR + paddedLeds, *sB = sG + paddedLeds;
+    // Planes are padded to a multiple of LedFrame::ALIGNMENT, itself a
+    // multiple of LANES, so the filter can write straight into them
+    static_assert(LedFrame::ALIGNMENT % LANES == 0, "Frame planes must hold whole vectors");
+    filter(
+        sR, sG, sB, tR, tG, tB,
+        dest.channel(LedFrame::R), dest.channel(LedFrame::G), dest.channel(LedFrame::B),
+        paddedLeds, wb, int16_t(options.cutThreshold), int16_t(options.cutRange), slope, scale
+    );
+}
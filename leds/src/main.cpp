@@ -0,0 +1,265 @@
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "LedShm.h"
+#include "NullSink.h"
+#include "FileSink.h"
+#include "SpiSink.h"
+#include "DdpSink.h"
+#include "TemporalFilter.h"
+
+const mode_t SHM_MODE = 0777;
+// Depends on the layout screenreader.app was started with
+off_t SHM_SIZE;
+
+// Time to wait for a frame before checking whether to quit
+const int64_t WAIT_TIMEOUT_NANOS = 1000000000;
+
+int shm_fd;
+void *shm = nullptr;
+LedShm::Ring *ring = nullptr;
+
+volatile sig_atomic_t running = 1;
+
+int openShm(){
+    shm_fd = shm_open(LedShm::NAME, O_RDWR, SHM_MODE);
+    if(shm_fd == -1){
+        perror("[LEDS] Could not open shm");
+        return 1;
+    }
+
+    struct stat st;
+    if(fstat(shm_fd, &st) != 0){
+        perror("[LEDS] Could not stat shm");
+        return 1;
+    }
+    SHM_SIZE = st.st_size;
+
+    // Read-write, as the futex and atomics live in the segment
+    shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if(shm == MAP_FAILED){
+        perror("[LEDS] Could not map shm");
+        return 1;
+    }
+
+    try {
+        ring = new LedShm::Ring(shm, SHM_SIZE);
+    } catch(const std::runtime_error &e){
+        fprintf(stderr, "[LEDS] %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
+
+// The segment belongs to screenreader.app, so it is not unlinked here
+int closeShm(){
+    delete ring;
+    ring = nullptr;
+
+    if(munmap((void*)shm, SHM_SIZE) != 0) return 1;
+
+    if(close(shm_fd) != 0) return 1;
+
+    return 0;
+}
+
+void callbackSIGINT(int sig, siginfo_t *info, void *ucontext) {
+    running = 0;
+}
+
+int setupSIGINT(){
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    // No SA_RESTART, so that waiting for a frame is interrupted
+    act.sa_flags = SA_SIGINFO;
+    act.sa_sigaction = callbackSIGINT;
+
+    if(sigaction(SIGINT , &act, NULL) != 0){ perror("sigaction int" ); return 1; }
+    if(sigaction(SIGTERM, &act, NULL) != 0){ perror("sigaction term"); return 1; }
+
+    return 0;
+}
+
+uint64_t monotonicNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+struct Options {
+    std::string sink = "null";
+    TemporalFilter::Options filter;
+    DdpSink::Options ddp;
+    LedFrame::Order spiOrder = LedFrame::GRB;
+};
+
+void usage(const char *argv0){
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --sink null|file:PATH|spi:DEVICE|ddp:HOST[:PORT]\n"
+        "                       Where to send LED colours (default: null);\n"
+        "                       file:- prints them to stdout, ddp sends them\n"
+        "                       over UDP to a controller such as WLED\n"
+        "  --keyframe-interval SECONDS\n"
+        "                       Time between ddp frames with every LED; the\n"
+        "                       others only have those that changed (default: 1)\n"
+        "  --max-bandwidth KBIT Bandwidth ddp output is kept under, in kbit/s,\n"
+        "                       by skipping frames (default: unlimited)\n"
+        "  --color-order rgb|rbg|grb|gbr|brg|bgr\n"
+        "                       Byte order of the colours sent to the LEDs\n"
+        "                       (default: grb for spi, rgb for ddp)\n"
+        "  --decay SECONDS      Time constant of the exponential smoothing\n"
+        "                       (default: 0.05)\n"
+        "  --cut-threshold N    Colour difference (0-255) above which an LED starts\n"
+        "                       reacting faster than --decay (default: 24)\n"
+        "  --cut-range N        Difference above the threshold at which an LED\n"
+        "                       jumps straight to its new colour (default: 64)\n",
+        argv0
+    );
+}
+
+Options parseOptions(int argc, char *argv[]){
+    Options opts;
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--help"){ usage(argv[0]); exit(0); }
+        if(i+1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+        const std::string val = argv[++i];
+        if(arg == "--sink"){
+            opts.sink = val;
+        } else if(arg == "--color-order"){
+            opts.spiOrder = opts.ddp.order = LedFrame::parseOrder(val);
+        } else if(arg == "--decay"){
+            char *end;
+            opts.filter.decay = strtod(val.c_str(), &end);
+            if(val.empty() || *end != '\0' || opts.filter.decay < 0)
+                throw std::invalid_argument("Invalid value '" + val + "' for " + arg);
+        } else if(arg == "--keyframe-interval" || arg == "--max-bandwidth"){
+            char *end;
+            const double d = strtod(val.c_str(), &end);
+            if(val.empty() || *end != '\0' || d < 0)
+                throw std::invalid_argument("Invalid value '" + val + "' for " + arg);
+            if(arg == "--keyframe-interval") opts.ddp.keyframeInterval = d;
+            else opts.ddp.maxBytesPerSecond = d * 1000 / 8;
+        } else if(arg == "--cut-threshold" || arg == "--cut-range"){
+            char *end;
+            const long n = strtol(val.c_str(), &end, 10);
+            const long min = (arg == "--cut-range" ? 1 : 0);
+            if(val.empty() || *end != '\0' || n < min || n > 255)
+                throw std::invalid_argument("Invalid value '" + val + "' for " + arg);
+            (arg == "--cut-range" ? opts.filter.cutRange : opts.filter.cutThreshold) = int(n);
+        } else {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    return opts;
+}
+
+LedSink *createSink(const std::string &spec, const Options &opts){
+    const size_t colon = spec.find(':');
+    const std::string kind = spec.substr(0, colon);
+    const std::string arg  = (colon == std::string::npos ? "" : spec.substr(colon+1));
+
+    if(kind == "null") return new NullSink();
+    if(kind == "file") return new FileSink(arg.empty() ? "-" : arg);
+    if(kind == "spi" ) return new SpiSink(arg.empty() ? "/dev/spidev0.0" : arg, opts.spiOrder);
+    if(kind == "ddp" ){
+        if(arg.empty()) throw std::invalid_argument("The ddp sink needs a host");
+        return new DdpSink(arg, opts.ddp);
+    }
+    throw std::invalid_argument("Unknown sink '" + spec + "'");
+}
+
+int main(int argc, char *argv[]){
+    Options opts;
+    try {
+        opts = parseOptions(argc, argv);
+    } catch(const std::invalid_argument &e){
+        fprintf(stderr, "[LEDS] %s\n", e.what());
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(openShm()){
+        return 1;
+    }
+
+    LedSink *sink = nullptr;
+    try {
+        sink = createSink(opts.sink, opts);
+    } catch(const std::exception &e){
+        fprintf(stderr, "[LEDS] Could not create sink: %s\n", e.what());
+        return 1;
+    }
+
+    if(setupSIGINT()){
+        fprintf(stderr, "[LEDS] Could not setup SIGINT");
+        return 1;
+    }
+
+    const size_t numLeds = ring->getNumLeds();
+    LedFrame shmColors(numLeds);
+    LedFrame output(numLeds);
+    TemporalFilter filter(numLeds, opts.filter);
+
+    uint64_t prevTime = monotonicNanos();
+    uint32_t published = ring->getPublished();
+    while(running){
+        // Sleep until screenreader.app publishes a new frame
+        const uint32_t newPublished = ring->waitForFrame(published, WAIT_TIMEOUT_NANOS);
+        if(newPublished == published) continue;
+        published = newPublished;
+
+        LedShm::FrameInfo info;
+        if(!ring->readLatest(shmColors, info)) continue;
+        const float intensity = ring->getIntensity() / float(LedShm::INTENSITY_MAX);
+
+        const uint64_t nowTime = monotonicNanos();
+        filter.process(shmColors, (nowTime - prevTime)*1e-9, intensity, output);
+        prevTime = nowTime;
+
+        try {
+            sink->write(output);
+        } catch(const std::exception &e){
+            fprintf(stderr, "[LEDS] %s\n", e.what());
+            break;
+        }
+
+        // Let screenreader.app measure the latency up to the LEDs
+        ring->report(LedShm::Feedback{info.number, nowTime, monotonicNanos()});
+    }
+
+    // Turn the LEDs off
+    output.clear();
+    try { sink->write(output); } catch(const std::exception &e){}
+
+    if(const DdpSink *ddp = dynamic_cast<const DdpSink*>(sink)){
+        const DdpSink::Stats stats = ddp->getStats();
+        fprintf(stderr,
+            "[LEDS] ddp: %llu frames, %llu keyframes, %llu skipped over budget, %llu packets, %llu bytes\n",
+            (unsigned long long)stats.frames,
+            (unsigned long long)stats.keyframes,
+            (unsigned long long)stats.skipped,
+            (unsigned long long)stats.packets,
+            (unsigned long long)stats.bytes
+        );
+    }
+    delete sink;
+
+    if(closeShm()){
+        fprintf(stderr, "[LEDS] Could not close shm");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "DdpSink.h"
+#include "LedFrame.h"
+
+/*
+ * Checks the packets DdpSink sends, with a UDP receiver on the loopback
+ * interface standing in for the controller: offsets and lengths, the PUSH
+ * flag, splitting at MAX_LEDS_PER_PACKET, merging of deltas across short
+ * gaps, and frames skipped for lack of budget being caught up by a later
+ * one. Exits with a non-zero status on the first failure.
+ */
+
+namespace {
+const size_t NUM_LEDS = 1000;
+// Unchanged LEDs the sink resends rather than start another packet; see
+// DdpSink.cpp
+const size_t MAX_GAP = (DdpSink::HEADER_SIZE + DdpSink::OVERHEAD_BYTES) / 3;
+
+struct Packet {
+    uint8_t flags, sequence, type, dest;
+    uint32_t offset;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief UDP socket on the loopback interface, and the strip of a
+ * controller that applies what it receives.
+ */
+class Receiver {
+    int fd;
+    uint16_t port;
+
+public:
+    std::vector<uint8_t> strip;
+
+    explicit Receiver(size_t numLeds): strip(numLeds*3, 0){
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if(fd == -1 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || getsockname(fd, (sockaddr*)&addr, &len) != 0){
+            perror("Could not open the receiver");
+            exit(1);
+        }
+        port = ntohs(addr.sin_port);
+    }
+
+    std::string getAddress() const { return "127.0.0.1:" + std::to_string(port); }
+
+    /**
+     * @brief Packets sent so far and not yet received, applied to the strip.
+     *
+     * Loopback datagrams are queued by the time the sink's send returns.
+     */
+    std::vector<Packet> receive(){
+        std::vector<Packet> packets;
+        uint8_t buffer[65536];
+        ssize_t n;
+        while((n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0){
+            Packet p;
+            p.flags    = buffer[0];
+            p.sequence = buffer[1];
+            p.type     = buffer[2];
+            p.dest     = buffer[3];
+            p.offset   = (uint32_t(buffer[4]) << 24) | (uint32_t(buffer[5]) << 16) | (uint32_t(buffer[6]) << 8) | buffer[7];
+            const size_t length = (size_t(buffer[8]) << 8) | buffer[9];
+            if(length != size_t(n) - DdpSink::HEADER_SIZE || p.offset + length > strip.size()){
+                fprintf(stderr, "Packet of %zd bytes with length %zu at offset %u\n", n, length, p.offset);
+                exit(1);
+            }
+            p.data.assign(buffer + DdpSink::HEADER_SIZE, buffer + n);
+            memcpy(strip.data() + p.offset, p.data.data(), length);
+            packets.push_back(p);
+        }
+        return packets;
+    }
+
+    ~Receiver(){ close(fd); }
+};
+
+void setLed(LedFrame &frame, size_t i, uint8_t r, uint8_t g, uint8_t b){
+    frame.channel(LedFrame::R)[i] = r;
+    frame.channel(LedFrame::G)[i] = g;
+    frame.channel(LedFrame::B)[i] = b;
+}
+
+// LED i is (i, 2i, 3i), plus a shift
+void fill(LedFrame &frame, uint8_t shift){
+    for(size_t i = 0; i < frame.getNumLeds(); ++i)
+        setLed(frame, i, uint8_t(i + shift), uint8_t(2*i + shift), uint8_t(3*i + shift));
+}
+
+/**
+ * @brief Check that a frame was sent as packets at the given LED offsets
+ * and counts, with PUSH on the last only, and that the controller now
+ * shows it.
+ */
+bool check(const char *name, Receiver &receiver, const LedFrame &frame, const std::vector<std::pair<size_t, size_t>> &expected){
+    const std::vector<Packet> packets = receiver.receive();
+    if(packets.size() != expected.size()){
+        fprintf(stderr, "%s: %zu packets instead of %zu\n", name, packets.size(), expected.size());
+        return false;
+    }
+    for(size_t i = 0; i < packets.size(); ++i){
+        const Packet &p = packets[i];
+        const bool last = (i+1 == packets.size());
+        if(p.flags != (0x40 | (last ? 0x01 : 0)) || p.type != 0x0b || p.dest != 0x01 ||
+           p.sequence < 1 || p.sequence > 15 || p.sequence != packets[0].sequence){
+            fprintf(stderr, "%s: packet %zu has flags %02x, sequence %d, type %02x, dest %02x\n", name, i, p.flags, p.sequence, p.type, p.dest);
+            return false;
+        }
+        if(p.offset != expected[i].first*3 || p.data.size() != expected[i].second*3){
+            fprintf(stderr, "%s: packet %zu has %zu bytes at offset %u instead of %zu at %zu\n", name, i,
+                p.data.size(), p.offset, expected[i].second*3, expected[i].first*3);
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> rgb(frame.getNumLeds()*3);
+    frame.interleave(rgb.data());
+    if(rgb != receiver.strip){
+        fprintf(stderr, "%s: the controller does not show the frame\n", name);
+        return false;
+    }
+    return true;
+}
+}
+
+int main(){
+    const size_t M = DdpSink::MAX_LEDS_PER_PACKET;
+
+    {
+        Receiver receiver(NUM_LEDS);
+        DdpSink::Options options;
+        options.keyframeInterval = 1000;
+        DdpSink sink(receiver.getAddress(), options);
+        LedFrame frame(NUM_LEDS);
+
+        // A keyframe, split at MAX_LEDS_PER_PACKET
+        fill(frame, 0);
+        sink.write(frame);
+        if(!check("keyframe", receiver, frame, {{0, M}, {M, M}, {2*M, NUM_LEDS - 2*M}})) return 1;
+
+        // Nothing changed, nothing sent
+        sink.write(frame);
+        if(!check("unchanged", receiver, frame, {})) return 1;
+
+        // Changes MAX_GAP LEDs apart are merged, further apart they are not
+        setLed(frame, 10, 1, 2, 3);
+        setLed(frame, 10 + MAX_GAP + 1, 1, 2, 3);
+        setLed(frame, 200, 1, 2, 3);
+        setLed(frame, 200 + MAX_GAP + 2, 1, 2, 3);
+        sink.write(frame);
+        if(!check("gaps", receiver, frame, {{10, MAX_GAP + 2}, {200, 1}, {200 + MAX_GAP + 2, 1}})) return 1;
+
+        // A changed run longer than a packet is split
+        for(size_t i = 100; i < 100 + M + 20; ++i) setLed(frame, i, 7, 8, 9);
+        sink.write(frame);
+        if(!check("long delta", receiver, frame, {{100, M}, {100 + M, 20}})) return 1;
+
+        // The last LED
+        setLed(frame, NUM_LEDS-1, 0, 0, 0);
+        sink.write(frame);
+        if(!check("last LED", receiver, frame, {{NUM_LEDS-1, 1}})) return 1;
+
+        const DdpSink::Stats stats = sink.getStats();
+        if(stats.frames != 5 || stats.keyframes != 1 || stats.packets != 9 || stats.skipped != 0){
+            fprintf(stderr, "stats: %llu frames, %llu keyframes, %llu packets, %llu skipped\n",
+                (unsigned long long)stats.frames, (unsigned long long)stats.keyframes,
+                (unsigned long long)stats.packets, (unsigned long long)stats.skipped);
+            return 1;
+        }
+    }
+
+    // With a budget of about one frame every 0.2 s, a frame right after a
+    // keyframe is skipped, and its changes go out with the next one sent
+    {
+        const size_t numLeds = 100;
+        Receiver receiver(numLeds);
+        DdpSink::Options options;
+        options.keyframeInterval = 1000;
+        options.maxBytesPerSecond = 5 * (DdpSink::OVERHEAD_BYTES + DdpSink::HEADER_SIZE + numLeds*3);
+        DdpSink sink(receiver.getAddress(), options);
+        LedFrame frame(numLeds);
+
+        fill(frame, 0);
+        sink.write(frame);
+        if(!check("budget keyframe", receiver, frame, {{0, numLeds}})) return 1;
+
+        fill(frame, 1);
+        sink.write(frame);
+        if(!receiver.receive().empty() || sink.getStats().skipped != 1){
+            fprintf(stderr, "over budget: the frame was not skipped\n");
+            return 1;
+        }
+
+        usleep(300000);
+        setLed(frame, 50, 4, 5, 6);
+        sink.write(frame);
+        if(!check("caught up", receiver, frame, {{0, numLeds}})) return 1;
+    }
+
+    printf("DdpSinkTest: OK\n");
+    return 0;
+}
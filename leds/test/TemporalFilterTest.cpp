@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "LedFrame.h"
+#include "TemporalFilter.h"
+
+/*
+ * Checks that the temporal filter passes colours through unchanged at full
+ * intensity once smoothing has settled, whatever it settled from. Exits
+ * with a non-zero status on the first failure.
+ */
+
+namespace {
+const size_t NUM_LEDS = 256;
+// Enough frames of 20 ms for any step to settle with the default decay
+const int SETTLE_FRAMES = 2000;
+
+// LED i has red i, green 255-i and blue i
+void fill(LedFrame &frame, bool inverted){
+    for(size_t i = 0; i < NUM_LEDS; ++i){
+        const uint8_t v = uint8_t(inverted ? 255-i : i);
+        frame.channel(LedFrame::R)[i] = v;
+        frame.channel(LedFrame::G)[i] = uint8_t(255-v);
+        frame.channel(LedFrame::B)[i] = v;
+    }
+}
+
+bool check(const char *name, const LedFrame &expected, const LedFrame &out){
+    for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c){
+        for(size_t i = 0; i < NUM_LEDS; ++i){
+            const uint8_t e = expected.channel(LedFrame::Channel(c))[i];
+            const uint8_t o = out.channel(LedFrame::Channel(c))[i];
+            if(e != o){
+                fprintf(stderr, "%s: LED %zu channel %d is %d instead of %d\n", name, i, c, o, e);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+}
+
+int main(){
+    LedFrame target(NUM_LEDS), other(NUM_LEDS), out(NUM_LEDS), black(NUM_LEDS);
+    fill(target, false);
+    fill(other, true);
+
+    // The first frame is taken as is
+    {
+        TemporalFilter filter(NUM_LEDS, TemporalFilter::Options());
+        filter.process(target, 0.02, 1.0f, out);
+        if(!check("first frame", target, out)) return 1;
+    }
+
+    // Settling from above and from below
+    for(const LedFrame *start: {&other, &black}){
+        TemporalFilter filter(NUM_LEDS, TemporalFilter::Options());
+        filter.process(*start, 0.02, 1.0f, out);
+        for(int i = 0; i < SETTLE_FRAMES; ++i) filter.process(target, 0.02, 1.0f, out);
+        if(!check(start == &black ? "settled from black" : "settled from inverse", target, out)) return 1;
+    }
+
+    // No intensity is black
+    {
+        TemporalFilter filter(NUM_LEDS, TemporalFilter::Options());
+        filter.process(target, 0.02, 0.0f, out);
+        if(!check("zero intensity", black, out)) return 1;
+    }
+
+    printf("TemporalFilterTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+/**
+ * @brief Work to be done once per frame.
+ */
+class AlarmTask {
+public:
+    virtual void execute() = 0;
+
+    virtual ~AlarmTask(){}
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "FrameSource.h"
+#include "ScreenReader.h"
+#include "ScreenProcessor.h"
+#include "LedFrame.h"
+#include "LedLayout.h"
+#include "LedProcessor.h"
+#include "WorkerPool.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Everything that turns one screen into the colours of one strip:
+ * frame source, reader, processor and LED processor.
+ *
+ * A process can host several chains, e.g. one per monitor of a desk or per
+ * screen of a video wall; they share the scheduler, the shared memory
+ * segment and the worker pool, and their LEDs are published one chain
+ * after the other.
+ */
+class CaptureChain {
+public:
+    struct Options {
+        ScreenProcessor::Mode reduction = ScreenProcessor::DIRECT;
+        /// Average in linear light; see LinearLight
+        bool linear = false;
+        /// Pixels captured in from each edge, or 0 for as deep as the LED
+        /// regions; see ScreenReader
+        int depth = 0;
+        /// Lines skipped across that depth; see ScreenReader
+        int step = 1;
+        /// Only recompute the LEDs whose regions changed
+        bool incremental = false;
+        /// Reduce sample regions and interpolate the LEDs from them; see
+        /// LedProcessor
+        LedProcessor::Sampling sampling;
+    };
+
+private:
+    std::unique_ptr<FrameSource> source;
+    LedLayout layout;
+    ScreenReader reader;
+    ScreenProcessor processor;
+    LedProcessor ledProcessor;
+    std::vector<LedLayout::Edge> edges;
+    /// Whether the last call to capture captured a frame
+    bool captured;
+
+public:
+    /**
+     * @brief Construct a new Capture Chain object
+     *
+     * @param source_   Source of screen contents; the chain takes ownership
+     *                  of it, even if construction fails
+     * @param layout_   Arrangement of the LEDs around the screen
+     * @param options   Capture and reduction options
+     */
+    CaptureChain(FrameSource *source_, const LedLayout &layout_, const Options &options);
+
+    size_t getNumLeds() const;
+
+    /**
+     * @brief Edge of the screen each LED is on, in strip order.
+     */
+    const std::vector<LedLayout::Edge> &getEdges() const;
+
+    void setPool(WorkerPool *pool);
+
+    /**
+     * @brief Capture a frame and compute the colours of the LEDs; same as
+     * capture followed by reduce.
+     *
+     * If the display is blanked, nothing is captured and the LEDs are set
+     * to black.
+     *
+     * @param dest      Frame to write the colours to
+     * @param offset    Index in dest of the first LED of the chain
+     * @return bool     Whether a frame was captured, i.e. the display is
+     *                  not blanked
+     */
+    bool update(LedFrame &dest, size_t offset = 0);
+
+    /**
+     * @brief Capture a frame, unless the display is blanked.
+     *
+     * @return bool     Whether a frame was captured
+     */
+    bool capture();
+
+    /**
+     * @brief Compute the colours of the LEDs from the last captured frame,
+     * or black if the display was blanked.
+     *
+     * @param dest      Frame to write the colours to
+     * @param offset    Index in dest of the first LED of the chain
+     */
+    void reduce(LedFrame &dest, size_t offset = 0);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "FrameSource.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frame source that plays back a file of raw frames.
+ *
+ * The file is a sequence of frames with no header, each frame being
+ * width*height pixels stored row-major, BGRA by default (for instance, the
+ * output of `ffmpeg -pix_fmt bgra -f rawvideo`, or `-pix_fmt rgb565le` for
+ * RGB565). Playback loops when the end of the file is reached.
+ */
+class FileFrameSource : public FrameSource {
+private:
+    struct Region {
+        std::vector<Rect> parts;
+        std::vector<uint8_t> data;
+    };
+
+    int screenWidth, screenHeight;
+    PixelFormat format;
+    int bytesPerPixel;
+
+    int fd;
+    const uint8_t *file;
+    size_t fileSize;
+    size_t numFrames;
+    size_t frame;
+
+    std::vector<Region> regions;
+
+    void copy(Region &region);
+
+public:
+    FileFrameSource(const std::string &path, int screenWidth_, int screenHeight_, PixelFormat format_ = ARGB8888);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+
+    virtual ~FileFrameSource();
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "AlarmTask.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/**
+ * @brief Runs a task periodically on a dedicated capture thread.
+ *
+ * Frames are paced with clock_nanosleep on absolute CLOCK_MONOTONIC
+ * deadlines, so the period does not drift with the time each frame takes.
+ * A frame that is still running when the next one is due makes the
+ * scheduler skip the frames it can no longer start on time, rather than
+ * running them late back-to-back.
+ *
+ * A frame whose task throws std::runtime_error, e.g. because the X server
+ * failed to capture the screen, is counted as failed and skipped, and the
+ * thread carries on with the next frame.
+ */
+class FrameScheduler {
+public:
+    struct Options {
+        /// Time between the start of consecutive frames, until setPeriod
+        /// changes it
+        int64_t periodNanos = 50000000;
+        /// SCHED_FIFO priority of the capture thread (1-99), or 0 to keep
+        /// the default scheduling policy
+        int priority = 0;
+        /// CPU to pin the capture thread to, or -1 to let it float
+        int cpu = -1;
+        /// Lock all current and future memory of the process, so the
+        /// capture thread never waits for a page fault
+        bool lockMemory = false;
+    };
+
+    struct Stats {
+        /// Frames executed
+        uint64_t frames;
+        /// Frames that took longer than one period
+        uint64_t missedDeadlines;
+        /// Frames not started because a previous frame overran
+        uint64_t skippedFrames;
+        /// Frames whose task threw std::runtime_error
+        uint64_t failedFrames;
+        /// Largest time a frame took, in nanoseconds
+        int64_t maxFrameNanos;
+    };
+
+private:
+    AlarmTask &task;
+    Options options;
+    std::atomic<int64_t> periodNanos;
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> missedDeadlines;
+    std::atomic<uint64_t> skippedFrames;
+    std::atomic<uint64_t> failedFrames;
+    std::atomic<int64_t> maxFrameNanos;
+
+    void setupThread();
+    void run();
+
+public:
+    FrameScheduler(AlarmTask &task_, const Options &options_);
+
+    /**
+     * @brief Start the capture thread.
+     *
+     * Real-time priority, CPU affinity and memory locking are best-effort:
+     * if not permitted (e.g., without CAP_SYS_NICE), a warning is printed
+     * and the thread runs without them.
+     */
+    void start();
+
+    /**
+     * @brief Stop the capture thread, after the frame in progress finishes.
+     */
+    void stop();
+
+    /**
+     * @brief Change the time between frames.
+     *
+     * Takes effect from the next deadline, without cutting short a wait in
+     * progress. Safe to call from the task itself.
+     */
+    void setPeriod(int64_t periodNanos_);
+
+    Stats getStats() const;
+
+    ~FrameScheduler();
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "PixelFormat.h"
+#include "Rect.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Source of screen contents.
+ *
+ * A frame source captures a fixed set of rectangular regions of the screen
+ * every time grab() is called. Regions are registered once, before the first
+ * grab, and are then referred to by the handle addRegion() returns.
+ *
+ * Pixels are in the format getPixelFormat() returns, which does not change
+ * over the life of the source, and are stored row-major with no padding
+ * between rows.
+ *
+ * A region can also be made of several parts, which are stored one after
+ * the other. This lets a caller capture, say, every fourth row of a strip
+ * (as parts one pixel high) or a strip column by column (as parts one pixel
+ * wide), without the pixels in between being copied.
+ */
+class FrameSource {
+public:
+    virtual int getScreenWidth () = 0;
+    virtual int getScreenHeight() = 0;
+
+    /**
+     * @brief Format of the pixels returned by getRegion.
+     */
+    virtual PixelFormat getPixelFormat(){ return ARGB8888; }
+
+    /**
+     * @brief Register a region to be captured on every grab.
+     *
+     * @param parts Parts of the region, in the order they are to be
+     *              stored; each must be within screen bounds
+     * @return int  Handle of the region
+     */
+    virtual int addRegion(const std::vector<Rect> &parts) = 0;
+
+    /**
+     * @brief Register a region made of a single rectangle.
+     */
+    int addRegion(const Rect &rect){ return addRegion(std::vector<Rect>(1, rect)); }
+
+    /**
+     * @brief Capture all registered regions.
+     */
+    virtual void grab() = 0;
+
+    /**
+     * @brief Get the pixels of a region, as captured by the last grab.
+     *
+     * The pointer is only guaranteed to be valid until the next grab.
+     *
+     * @param handle        Handle returned by addRegion
+     * @return const void*  Row-major pixels of each part of the region,
+     *                      one part after the other
+     */
+    virtual const void *getRegion(int handle) = 0;
+
+    /**
+     * @brief Whether the display is blanked (e.g., by DPMS power saving),
+     * in which case there is no point in grabbing.
+     */
+    virtual bool isBlanked(){ return false; }
+
+    virtual ~FrameSource(){}
+};
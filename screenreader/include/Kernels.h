@@ -0,0 +1,102 @@
+#pragma once
+
+#include "LinearLight.h"
+#include "PixelFormat.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Pixel reduction kernels.
+ *
+ * Each kernel comes in a scalar version and, where the CPU supports it,
+ * vectorized versions (SSE2/AVX2 on x86, NEON on ARM). The fastest version
+ * the CPU supports is selected the first time the kernels are used.
+ */
+namespace Kernels {
+    /**
+     * @brief Add up the channels of a row of BGRA pixels.
+     *
+     * The alpha channel is ignored, so pixels need not have it set.
+     *
+     * @param row   Pixels, 0xAARRGGBB
+     * @param n     Number of pixels
+     * @param sums  R, G and B sums to add to
+     */
+    typedef void (*SumRowFunction)(const uint32_t *row, int n, uint32_t sums[3]);
+
+    extern SumRowFunction sumRow;
+
+    /**
+     * @brief Add up the channels of a row of pixels of format F.
+     *
+     * 32-bit formats use the vectorized kernels; other formats are decoded
+     * by an inlined loop specialized for them.
+     *
+     * @param row   Pixels
+     * @param n     Number of pixels
+     * @param sums  R, G and B sums to add to
+     */
+    template<PixelFormat F>
+    inline void sumRowOf(const typename PixelTraits<F>::Pixel *row, int n, uint32_t sums[3]){
+        typedef PixelTraits<F> T;
+        uint32_t r = 0, g = 0, b = 0;
+        for(int i = 0; i < n; ++i){
+            r += T::red  (row[i]);
+            g += T::green(row[i]);
+            b += T::blue (row[i]);
+        }
+        sums[0] += r;
+        sums[1] += g;
+        sums[2] += b;
+    }
+
+    template<>
+    inline void sumRowOf<ARGB8888>(const uint32_t *row, int n, uint32_t sums[3]){
+        sumRow(row, n, sums);
+    }
+
+    template<>
+    inline void sumRowOf<ABGR8888>(const uint32_t *row, int n, uint32_t sums[3]){
+        // The kernels sum bytes 2, 1 and 0 as R, G and B; here byte 0 is R
+        uint32_t swapped[3] = {0, 0, 0};
+        sumRow(row, n, swapped);
+        sums[0] += swapped[2];
+        sums[1] += swapped[1];
+        sums[2] += swapped[0];
+    }
+
+    /**
+     * @brief Add up the channels of a row of pixels of format F, in linear
+     * light; see LinearLight.
+     *
+     * Each channel is decoded through a table as it is added, so this costs
+     * three table lookups per pixel over sumRowOf.
+     */
+    template<PixelFormat F>
+    inline void sumRowLinearOf(const typename PixelTraits<F>::Pixel *row, int n, uint32_t sums[3]){
+        typedef PixelTraits<F> T;
+        const uint16_t *decode = LinearLight::DECODE;
+        uint32_t r = 0, g = 0, b = 0;
+        for(int i = 0; i < n; ++i){
+            r += decode[T::red  (row[i])];
+            g += decode[T::green(row[i])];
+            b += decode[T::blue (row[i])];
+        }
+        sums[0] += r;
+        sums[1] += g;
+        sums[2] += b;
+    }
+
+    /**
+     * @brief Name of the implementation in use (e.g., "avx2").
+     */
+    const char *getImplementation();
+
+    /**
+     * @brief Force an implementation: "scalar", "sse2", "avx2" or "neon".
+     *
+     * @throws std::invalid_argument if unknown or not supported by this CPU
+     */
+    void setImplementation(const std::string &name);
+}
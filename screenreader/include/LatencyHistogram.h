@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Histogram of latencies with a bounded relative error, in the style
+ * of HdrHistogram.
+ *
+ * Values below 2^SUB_BITS nanoseconds each get their own bucket; above that,
+ * every power of two is split into 2^SUB_BITS buckets of equal width, so a
+ * value is known to within 1/2^SUB_BITS (about 3%) whatever its magnitude.
+ * Recording is a handful of instructions and never allocates.
+ *
+ * One thread records; any thread may take a snapshot at any time, which
+ * may then miss the values recorded concurrently.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 5;
+    /// Values from this on, about 69 s, are counted as this
+    static const int64_t MAX_VALUE = (int64_t(1) << 36) - 1;
+
+    struct Snapshot {
+        uint64_t count;
+        int64_t min, max;
+        double mean;
+        std::vector<uint64_t> counts;
+
+        /**
+         * @brief Smallest value that at least a fraction p of the values are
+         * less than or equal to, rounded up to the end of its bucket.
+         *
+         * @param p     Fraction, from 0 to 1
+         * @return int64_t  Value in nanoseconds, or 0 if there are none
+         */
+        int64_t getPercentile(double p) const;
+    };
+
+private:
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int NUM_BUCKETS = (36 - SUB_BITS + 1) * SUB_COUNT;
+
+    std::vector<std::atomic<uint64_t>> counts;
+    std::atomic<uint64_t> count;
+    std::atomic<int64_t> min, max;
+    std::atomic<int64_t> sum;
+
+    static int getBucket(int64_t value);
+    static int64_t getBucketEnd(int bucket);
+
+public:
+    LatencyHistogram();
+
+    /**
+     * @brief Count a latency; negative values are counted as 0.
+     */
+    void record(int64_t nanos);
+
+    Snapshot getSnapshot() const;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "LedShm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Latency of every stage between the screen and the LEDs.
+ *
+ * The writer records the timestamps of each frame it publishes, and the
+ * feedback the consumer leaves in the shared memory segment; the stages
+ * after publication are measured once the consumer reports on a frame the
+ * writer still remembers.
+ */
+class LatencyTracker {
+public:
+    enum Stage {
+        /// Capture start to capture end
+        CAPTURE,
+        /// Capture end to colours computed
+        REDUCE,
+        /// Colours computed to published
+        PUBLISH,
+        /// Published to read by the consumer
+        HANDOFF,
+        /// Read by the consumer to sent to the LEDs
+        OUTPUT,
+        /// Capture start to sent to the LEDs
+        TOTAL,
+        NUM_STAGES
+    };
+
+    static const char *getStageName(Stage stage);
+
+private:
+    struct Frame {
+        uint64_t number;
+        LedShm::Timestamps timestamps;
+        bool valid;
+    };
+
+    /// Recent frames, by number modulo their count
+    std::vector<Frame> frames;
+    uint64_t lastFeedback;
+    bool anyFeedback;
+
+    LatencyHistogram histograms[NUM_STAGES];
+
+public:
+    /**
+     * @brief Construct a new Latency Tracker object
+     *
+     * @param history   Number of recent frames to remember, for when the
+     *                  consumer reports on them
+     */
+    LatencyTracker(size_t history);
+
+    /**
+     * @brief Record the stages of a frame up to its publication.
+     */
+    void recordFrame(uint64_t number, const LedShm::Timestamps &timestamps);
+
+    /**
+     * @brief Record the stages after publication of the frame a consumer
+     * reported on; reports on the same frame are only counted once.
+     */
+    void recordFeedback(const LedShm::Feedback &feedback);
+
+    LatencyHistogram::Snapshot getSnapshot(Stage stage) const;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief Colours of a strip of LEDs, as planar R, G and B arrays.
+ *
+ * Colours flow between stages (reduction, rate control, shared memory,
+ * smoothing) in this form, so that every stage can process a channel of
+ * many LEDs at a time; they are interleaved only once, by the sink, in the
+ * byte order of the output device.
+ *
+ * Each plane starts on an ALIGNMENT-byte boundary and is padded to a
+ * multiple of ALIGNMENT bytes, so vector loops can run over whole planes
+ * without a scalar tail. Padding is zero unless a stage writes to it.
+ */
+class LedFrame {
+public:
+    static const size_t ALIGNMENT = 64;
+
+    enum Channel {
+        R,
+        G,
+        B,
+        NUM_CHANNELS
+    };
+
+    /**
+     * @brief Byte order of the colours of an LED, e.g. GRB for WS2812.
+     */
+    enum Order {
+        RGB,
+        RBG,
+        GRB,
+        GBR,
+        BRG,
+        BGR,
+        NUM_ORDERS
+    };
+
+private:
+    size_t numLeds;
+    /// Bytes from one plane to the next
+    size_t stride;
+    uint8_t *data;
+
+    void allocate(){
+        data = nullptr;
+        if(stride == 0) return;
+        void *p = nullptr;
+        if(posix_memalign(&p, ALIGNMENT, NUM_CHANNELS*stride) != 0) throw std::bad_alloc();
+        data = (uint8_t*)p;
+        memset(data, 0, NUM_CHANNELS*stride);
+    }
+
+    static const Channel *getChannels(Order order){
+        static const Channel CHANNELS[NUM_ORDERS][NUM_CHANNELS] = {
+            {R, G, B}, {R, B, G}, {G, R, B}, {G, B, R}, {B, R, G}, {B, G, R}
+        };
+        return CHANNELS[order];
+    }
+
+public:
+    explicit LedFrame(size_t numLeds_ = 0):
+        numLeds(numLeds_),
+        stride((numLeds_ + ALIGNMENT-1) / ALIGNMENT * ALIGNMENT)
+    {
+        allocate();
+    }
+
+    LedFrame(const LedFrame &other):
+        numLeds(other.numLeds),
+        stride(other.stride)
+    {
+        allocate();
+        if(data) memcpy(data, other.data, NUM_CHANNELS*stride);
+    }
+
+    LedFrame &operator=(const LedFrame &other){
+        if(this != &other){
+            if(stride != other.stride){
+                free(data);
+                stride = other.stride;
+                allocate();
+            }
+            numLeds = other.numLeds;
+            if(data) memcpy(data, other.data, NUM_CHANNELS*stride);
+        }
+        return *this;
+    }
+
+    ~LedFrame(){ free(data); }
+
+    size_t getNumLeds() const { return numLeds; }
+
+    /**
+     * @brief Bytes from the start of one plane to the next; a multiple of
+     * ALIGNMENT, and at least getNumLeds().
+     */
+    size_t getStride() const { return stride; }
+
+    uint8_t       *channel(Channel c)      { return data + c*stride; }
+    const uint8_t *channel(Channel c) const{ return data + c*stride; }
+
+    /**
+     * @brief Set count LEDs from the first one to black.
+     */
+    void clear(size_t first, size_t count){
+        for(int c = 0; c < NUM_CHANNELS; ++c) memset(channel(Channel(c)) + first, 0, count);
+    }
+
+    void clear(){ clear(0, numLeds); }
+
+    /**
+     * @brief Write count LEDs from the first one as bytes in the given order.
+     *
+     * @param dest  Where to write 3*count bytes
+     */
+    void interleave(uint8_t *dest, Order order, size_t first, size_t count) const {
+        const Channel *channels = getChannels(order);
+        const uint8_t *p0 = channel(channels[0]) + first;
+        const uint8_t *p1 = channel(channels[1]) + first;
+        const uint8_t *p2 = channel(channels[2]) + first;
+        for(size_t i = 0; i < count; ++i){
+            *(dest++) = p0[i];
+            *(dest++) = p1[i];
+            *(dest++) = p2[i];
+        }
+    }
+
+    void interleave(uint8_t *dest, Order order = RGB) const { interleave(dest, order, 0, numLeds); }
+
+    /**
+     * @brief Channel at each position of an order, e.g. {G, R, B} for GRB.
+     */
+    static Channel getChannel(Order order, int position){ return getChannels(order)[position]; }
+
+    /**
+     * @brief Parse the name of an order, e.g. "grb".
+     *
+     * @throws std::invalid_argument if the name is unknown
+     */
+    static Order parseOrder(const std::string &name){
+        static const char *NAMES[NUM_ORDERS] = {"rgb", "rbg", "grb", "gbr", "brg", "bgr"};
+        for(int i = 0; i < NUM_ORDERS; ++i){
+            if(name == NAMES[i]) return Order(i);
+        }
+        throw std::invalid_argument("Unknown colour order '" + name + "'");
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Rect.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Physical arrangement of the LED strip around the screen.
+ *
+ * The strip runs around the four edges of the screen, starting at one of the
+ * corners and going either clockwise or counterclockwise (as seen by the
+ * viewer). Each edge has its own number of LEDs. A corner gap of g means each
+ * edge is divided in count+2g cells of which the g cells at each end have no
+ * LED. Skipped LEDs are positions along the strip (counted before skipping)
+ * where there is no LED, e.g. where the strip is cut around the TV stand;
+ * they do not appear in the output.
+ *
+ * A layout file has one `key = value` per line; lines starting with # are
+ * comments. See layout.conf for the available keys.
+ */
+class LedLayout {
+public:
+    enum Edge {
+        BOTTOM,
+        LEFT,
+        TOP,
+        RIGHT,
+        NUM_EDGES
+    };
+
+    enum Corner {
+        BOTTOM_RIGHT,
+        BOTTOM_LEFT,
+        TOP_LEFT,
+        TOP_RIGHT
+    };
+
+    enum Direction {
+        CLOCKWISE,
+        COUNTERCLOCKWISE
+    };
+
+    /**
+     * @brief Position of one LED.
+     */
+    struct Slot {
+        Edge edge;
+        /// Region of the screen the LED takes its colour from
+        Rect rect;
+    };
+
+private:
+    Corner start;
+    Direction direction;
+    int count[NUM_EDGES];
+    int cornerGap;
+    std::set<int> skip;
+
+public:
+    /**
+     * @brief Construct the default layout: starting at the bottom-right
+     * corner, clockwise, with NUM_LEDS_X LEDs along the top and bottom and
+     * NUM_LEDS_Y along the sides.
+     */
+    LedLayout(int NUM_LEDS_X = 32, int NUM_LEDS_Y = 20);
+
+    /**
+     * @brief Load a layout from a file.
+     *
+     * @throws std::invalid_argument if the file cannot be read or is malformed
+     */
+    static LedLayout fromFile(const std::string &path);
+
+    int getCount(Edge edge) const;
+
+    /**
+     * @brief Number of LEDs in the strip, excluding skipped ones.
+     */
+    int getNumLeds() const;
+
+    /**
+     * @brief Number of cells along the top/bottom edges (including gaps).
+     *
+     * The screen width divided by this is the depth of the side regions.
+     */
+    int getCellsX() const;
+
+    /**
+     * @brief Number of cells along the left/right edges (including gaps).
+     *
+     * The screen height divided by this is the depth of the top/bottom regions.
+     */
+    int getCellsY() const;
+
+    /**
+     * @brief Compute the position of every LED, in strip order.
+     *
+     * @param screenWidth   Width of the screen
+     * @param screenHeight  Height of the screen
+     * @param depth         If positive, limit regions to this many pixels
+     *                      in from their edge
+     * @return std::vector<Slot> One slot per LED, skipped LEDs excluded
+     */
+    std::vector<Slot> getSlots(int screenWidth, int screenHeight, int depth = 0) const;
+};
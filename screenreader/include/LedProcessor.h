@@ -1,31 +1,132 @@
 #pragma once
 
 #include "ScreenProcessor.h"
+#include "LedFrame.h"
+#include "LedLayout.h"
+#include "WorkerPool.h"
 
 #include <chrono>
+#include <string>
 #include <vector>
 
+/**
+ * @brief Computes the colour of every LED of a strip from a ScreenProcessor.
+ *
+ * By default each LED is the average of its own region. With sampling, a
+ * fixed set of sample regions is reduced instead, and each LED is blended
+ * from the samples nearest to it along its edge, through a sparse weight
+ * matrix computed once; a dense strip then costs about as much as its
+ * samples, plus a few multiply-adds per LED.
+ */
 class LedProcessor {
+public:
+    enum Interpolation {
+        /// Between the two nearest samples
+        LINEAR,
+        /// Catmull-Rom spline through the four nearest samples, which keeps
+        /// gradients smooth across samples but can overshoot on sharp edges
+        CATMULL_ROM
+    };
+
+    struct Sampling {
+        /// Sample regions along the top and bottom edges, and along the
+        /// sides, at most one per LED; 0 to reduce one region per LED
+        int countX, countY;
+        Interpolation interpolation;
+
+        Sampling(): countX(0), countY(0), interpolation(LINEAR){}
+
+        bool enabled() const { return countX > 0 || countY > 0; }
+    };
+
+    /**
+     * @brief Parse the name of an interpolation, "linear" or "spline".
+     *
+     * @throws std::invalid_argument if the name is unknown
+     */
+    static Interpolation parseInterpolation(const std::string &s);
+
+    /**
+     * @brief Regions reduced with the given sampling: those of the LEDs
+     * themselves, or samples of equal length that split the span the LEDs
+     * of each edge cover, as deep as the LEDs' regions.
+     *
+     * Samples therefore lie within what the ScreenReader captures for the
+     * LED layout, and keep its corner gaps; edges without LEDs get none.
+     *
+     * @param leds      Slots of the LEDs, from LedLayout::getSlots
+     */
+    static std::vector<LedLayout::Slot> getSampleSlots(const std::vector<LedLayout::Slot> &leds, const Sampling &sampling);
+
+private:
+    /// Reduces a range of LEDs, so that the pool can split them
+    class ReduceTask : public WorkerPool::Task {
+        LedProcessor &ledProcessor;
+    public:
+        ReduceTask(LedProcessor &ledProcessor_): ledProcessor(ledProcessor_){}
+        virtual void execute(size_t begin, size_t end){ ledProcessor.reduce(begin, end); }
+    };
+
     ScreenProcessor &processor;
-    const int NUM_LEDS_X;
-    const int NUM_LEDS_Y;
-    const int SIZE_X;
-    const int SIZE_Y;
-    const int PIXELS_PER_LED_X;
-    const int PIXELS_PER_LED_Y;
-
-    std::pair<int, int> indexToPixel(int i);
+    WorkerPool *pool;
+    ReduceTask reduceTask;
+
+    /// Regions reduced: that of each LED in strip order, or the samples;
+    /// computed once, as the layout never changes
+    std::vector<Rect> regions;
+
+    /// Colour of each region, recomputed only when the region changes
+    std::vector<Color<uint8_t>> colors;
+    bool first;
+
+    /// Fixed-point weight of one sample in the colour of an LED
+    struct Weight {
+        uint32_t sample;
+        int32_t weight;
+    };
+    static const int WEIGHT_BITS = 14;
+
+    /// With sampling, the weights of LED i are weights[rowStart[i]] up to
+    /// weights[rowStart[i+1]] (compressed sparse rows); empty otherwise
+    std::vector<uint32_t> rowStart;
+    std::vector<Weight> weights;
+    size_t numLeds;
+
+    void reduce(size_t begin, size_t end);
+    void buildWeights(const std::vector<LedLayout::Slot> &leds, const std::vector<LedLayout::Slot> &samples, Interpolation interpolation);
 public:
     /**
      * @brief Construct a new Led Processor object
      * 
-     * @param processor_ 
-     * @param NUM_LEDS_X_ 
-     * @param NUM_LEDS_Y_ 
+     * @param processor_    Processor to take colours from
+     * @param layout        Arrangement of the LEDs around the screen
+     * @param depth         If positive, limit regions to this many pixels
+     *                      in from their edge; should match the depth the
+     *                      ScreenReader captures
+     * @param sampling      Sample regions to reduce instead of one region
+     *                      per LED; see getSampleSlots
+     * @throws std::invalid_argument if an edge with LEDs has no samples
      */
-    LedProcessor(ScreenProcessor &processor_, const int NUM_LEDS_X_, const int NUM_LEDS_Y_);
+    LedProcessor(ScreenProcessor &processor_, const LedLayout &layout, int depth = 0, const Sampling &sampling = Sampling());
+
+    size_t getNumLeds() const;
+
+    /**
+     * @brief Split the reduction of the LEDs across a pool of threads.
+     *
+     * @param pool_     Pool to use, or nullptr to reduce on the calling thread
+     */
+    void setPool(WorkerPool *pool_);
 
     void update();
 
-    size_t copy(uint8_t *dest);
+    /**
+     * @brief Compute the colours of the LEDs and write them to a frame.
+     *
+     * @param dest      Frame to write to, with room for at least
+     *                  offset + getNumLeds() LEDs
+     * @param offset    Index in dest of the first LED of the strip
+     * @return size_t   Number of LEDs written
+     */
+    size_t copy(LedFrame &dest, size_t offset = 0);
 };
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "LedFrame.h"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Layout of the /shm_leds shared memory segment, and lock-free
+ * access to it.
+ *
+ * The segment starts with a Header, followed by a ring of numFrames frames,
+ * each frameSize bytes long. A frame is a FrameHeader followed by the colours
+ * of every LED, in strip order, as planes: the red value of every LED, then
+ * the green ones, then the blue ones, numLeds bytes each. Consumers
+ * interleave them in the byte order of their LEDs.
+ *
+ * There is a single writer (screenreader.app) and any number of readers.
+ * The writer never waits for readers: each frame slot has a sequence counter
+ * that is odd while the slot is being written (a seqlock), and readers retry
+ * if the counter changed while they were copying the frame. After a frame is
+ * complete, the writer increments Header::published; the latest frame is in
+ * slot (published-1) % numFrames.
+ *
+ * Header::published doubles as a futex: after each frame the writer wakes
+ * every process waiting on it, so readers can sleep until a new frame is
+ * published instead of polling.
+ *
+ * Each frame carries the CLOCK_MONOTONIC times at which its capture started,
+ * its capture ended, its colours were computed and it was published. The
+ * consumer that drives the LEDs reports back when it received a frame and
+ * when it sent it to the LEDs, in the feedback fields of the Header (a
+ * seqlock too), so the writer can measure the latency of every stage. A
+ * consumer that dies while writing them would leave that seqlock odd for
+ * good, so the writer resets it to 0 (no feedback) once it has stayed odd
+ * for FEEDBACK_TIMEOUT_NANOS.
+ *
+ * All fields are little-endian, at fixed offsets, so that readers in other
+ * languages (see leds.py) can use the segment too. Atomics are 32-bit so
+ * they are lock-free even on 32-bit Raspberry Pis.
+ */
+namespace LedShm {
+
+const char NAME[] = "/shm_leds";
+
+const uint32_t MAGIC   = 0x5344454c; // "LEDS"
+const uint16_t VERSION = 3;
+
+const uint32_t DEFAULT_NUM_FRAMES = 8;
+
+const uint16_t INTENSITY_MAX = 100;
+
+/// Time after which a feedback report still being written is abandoned
+const uint64_t FEEDBACK_TIMEOUT_NANOS = 1000000000;
+
+struct Header {
+    uint32_t magic;                     //  0
+    uint16_t version;                   //  4
+    uint16_t headerSize;                //  6
+    uint32_t numLeds;                   //  8
+    uint32_t numFrames;                 // 12
+    uint32_t frameSize;                 // 16
+    uint32_t frameHeaderSize;           // 20
+    std::atomic<uint16_t> intensity;    // 24, percentage set by intensity.app
+    uint16_t reserved0;                 // 26
+    uint32_t reserved1;                 // 28
+    std::atomic<uint32_t> published;    // 32, number of frames published so far; also a futex
+    std::atomic<uint32_t> feedbackSeq;  // 36, odd while a consumer writes feedback; 0 if none yet
+    uint64_t feedbackNumber;            // 40, frame the consumer last sent to the LEDs
+    uint64_t feedbackReceived;          // 48, CLOCK_MONOTONIC nanoseconds when it read that frame
+    uint64_t feedbackOutput;            // 56, and when it finished sending it to the LEDs
+};
+
+struct FrameHeader {
+    std::atomic<uint32_t> seq;          //  0, odd while the frame is being written
+    uint32_t reserved0;                 //  4
+    uint64_t number;                    //  8, index of the frame since the writer started
+    uint64_t timestamp;                 // 16, CLOCK_MONOTONIC nanoseconds when published
+    uint64_t captureStart;              // 24, and when its capture started,
+    uint64_t captureEnd;                // 32, when its capture ended
+    uint64_t reduceEnd;                 // 40, and when its colours were computed
+    uint64_t reserved1[2];              // 48
+};
+
+static_assert(sizeof(Header) == 64, "Header must be 64 bytes");
+static_assert(offsetof(Header, published) == 32, "Header layout must not change");
+static_assert(offsetof(Header, feedbackNumber) == 40, "Header layout must not change");
+static_assert(sizeof(FrameHeader) == 64, "FrameHeader must be 64 bytes");
+static_assert(ATOMIC_INT_LOCK_FREE   == 2, "32-bit atomics must be lock-free to be shared between processes");
+static_assert(ATOMIC_SHORT_LOCK_FREE == 2, "16-bit atomics must be lock-free to be shared between processes");
+
+/**
+ * @brief CLOCK_MONOTONIC times of the stages of a frame, in nanoseconds.
+ */
+struct Timestamps {
+    uint64_t captureStart;
+    uint64_t captureEnd;
+    uint64_t reduceEnd;
+    uint64_t published;
+};
+
+/**
+ * @brief Metadata of a frame read from the ring.
+ */
+struct FrameInfo {
+    uint64_t number;
+    Timestamps timestamps;
+};
+
+/**
+ * @brief What a consumer did with a frame, with CLOCK_MONOTONIC times in
+ * nanoseconds.
+ */
+struct Feedback {
+    /// Number of the frame, from FrameInfo
+    uint64_t number;
+    /// When the consumer read the frame
+    uint64_t received;
+    /// When the consumer finished sending the frame to the LEDs
+    uint64_t output;
+};
+
+inline size_t getFrameSize(uint32_t numLeds){
+    // Keep frames on separate cache lines
+    return (sizeof(FrameHeader) + size_t(numLeds)*3 + 63) / 64 * 64;
+}
+
+inline size_t getSize(uint32_t numLeds, uint32_t numFrames){
+    return sizeof(Header) + getFrameSize(numLeds)*numFrames;
+}
+
+class Ring {
+private:
+    Header *header;
+
+    /// Odd feedback sequence readFeedback last saw, and when it first saw
+    /// it; 0 if the sequence was even
+    uint32_t stuckSeq;
+    uint64_t stuckSince;
+
+    static uint64_t monotonicNanos(){
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+    }
+
+    /**
+     * @brief Reset the feedback sequence to 0 if it has been odd, with the
+     * same value, for FEEDBACK_TIMEOUT_NANOS.
+     */
+    void recoverFeedback(uint32_t seq){
+        const uint64_t now = monotonicNanos();
+        if(seq != stuckSeq){
+            stuckSeq = seq;
+            stuckSince = now;
+            return;
+        }
+        if(now - stuckSince < FEEDBACK_TIMEOUT_NANOS) return;
+
+        // Fails harmlessly if the consumer finished in the meantime
+        header->feedbackSeq.compare_exchange_strong(seq, 0, std::memory_order_relaxed);
+        stuckSeq = 0;
+    }
+
+    FrameHeader *getFrame(uint32_t slot) const {
+        return (FrameHeader*)((uint8_t*)header + header->headerSize + size_t(slot)*header->frameSize);
+    }
+
+public:
+    /**
+     * @brief Access a segment that has already been initialized.
+     *
+     * @param shm   Start of the mapped segment
+     * @param size  Size of the mapped segment
+     * @throws std::runtime_error if the segment is not a compatible ring
+     */
+    Ring(void *shm, size_t size):
+        header((Header*)shm),
+        stuckSeq(0),
+        stuckSince(0)
+    {
+        if(size < sizeof(Header) || header->magic != MAGIC)
+            throw std::runtime_error("Shared memory is not an LED frame ring");
+        if(header->version != VERSION)
+            throw std::runtime_error("Unsupported LED frame ring version");
+        if(size < header->headerSize + size_t(header->frameSize)*header->numFrames)
+            throw std::runtime_error("LED frame ring is truncated");
+    }
+
+    /**
+     * @brief Initialize a segment of at least getSize(numLeds, numFrames) bytes.
+     */
+    static void init(void *shm, uint32_t numLeds, uint32_t numFrames, uint16_t intensity){
+        memset(shm, 0, getSize(numLeds, numFrames));
+        Header *h = (Header*)shm;
+        h->version         = VERSION;
+        h->headerSize      = sizeof(Header);
+        h->numLeds         = numLeds;
+        h->numFrames       = numFrames;
+        h->frameSize       = getFrameSize(numLeds);
+        h->frameHeaderSize = sizeof(FrameHeader);
+        h->intensity.store(intensity, std::memory_order_relaxed);
+        h->published.store(0, std::memory_order_relaxed);
+        // Readers check the magic number last
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = MAGIC;
+    }
+
+    uint32_t getNumLeds  () const { return header->numLeds  ; }
+    uint32_t getNumFrames() const { return header->numFrames; }
+
+    uint16_t getIntensity() const { return header->intensity.load(std::memory_order_relaxed); }
+    std::atomic<uint16_t> &intensity(){ return header->intensity; }
+
+    /**
+     * @brief Number of frames published so far (modulo 2^32).
+     */
+    uint32_t getPublished() const { return header->published.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Publish a frame; only one thread may do this.
+     *
+     * @param colors        Colours of at least numLeds LEDs
+     * @param timestamps    Times of the stages of the frame
+     * @return uint64_t     Number of the frame
+     */
+    uint64_t publish(const LedFrame &colors, const Timestamps &timestamps){
+        const uint32_t n = header->published.load(std::memory_order_relaxed);
+        FrameHeader *frame = getFrame(n % header->numFrames);
+
+        const uint32_t seq = frame->seq.load(std::memory_order_relaxed);
+        frame->seq.store(seq+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        frame->number       = n;
+        frame->timestamp    = timestamps.published;
+        frame->captureStart = timestamps.captureStart;
+        frame->captureEnd   = timestamps.captureEnd;
+        frame->reduceEnd    = timestamps.reduceEnd;
+        uint8_t *data = (uint8_t*)(frame+1);
+        for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c)
+            memcpy(data + c*size_t(header->numLeds), colors.channel(LedFrame::Channel(c)), header->numLeds);
+
+        frame->seq.store(seq+2, std::memory_order_release);
+        header->published.store(n+1, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * @brief Wake all readers waiting in waitForFrame.
+     *
+     * Call after publish; costs one system call.
+     */
+    void notify(){
+        syscall(SYS_futex, (uint32_t*)&header->published, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+
+    /**
+     * @brief Sleep until a frame after the first `seen` frames is published.
+     *
+     * @param seen          Value of getPublished() the caller has caught up to
+     * @param timeoutNanos  Maximum time to wait, or a negative value to wait
+     *                      forever
+     * @return uint32_t     New value of getPublished(); equal to seen if the
+     *                      wait timed out or was interrupted by a signal
+     */
+    uint32_t waitForFrame(uint32_t seen, int64_t timeoutNanos = -1) const {
+        uint32_t published = getPublished();
+        if(published != seen) return published;
+
+        timespec timeout;
+        timeout.tv_sec  = timeoutNanos / 1000000000;
+        timeout.tv_nsec = timeoutNanos % 1000000000;
+
+        // Returns immediately if published != seen by the time the kernel
+        // checks, so a frame published in between is never missed
+        syscall(SYS_futex, (uint32_t*)&header->published, FUTEX_WAIT, seen, timeoutNanos < 0 ? NULL : &timeout, NULL, 0);
+        return getPublished();
+    }
+
+    /**
+     * @brief Read a frame, without ever blocking the writer.
+     *
+     * @param index Index of the frame (published-1 for the latest); only the
+     *              last numFrames frames are available
+     * @param colors    Where to copy the colours to; at least numLeds LEDs
+     * @param info      Metadata of the frame
+     * @return true if the frame was read; false if it has not been published
+     *         yet or was already overwritten
+     */
+    bool read(uint32_t index, LedFrame &colors, FrameInfo &info) const {
+        const FrameHeader *frame = getFrame(index % header->numFrames);
+        while(true){
+            const uint32_t published = header->published.load(std::memory_order_acquire);
+            if(published - index - 1 >= header->numFrames) return false;
+
+            const uint32_t seq = frame->seq.load(std::memory_order_acquire);
+            if(seq & 1) continue;
+
+            info.number                  = frame->number;
+            info.timestamps.captureStart = frame->captureStart;
+            info.timestamps.captureEnd   = frame->captureEnd;
+            info.timestamps.reduceEnd    = frame->reduceEnd;
+            info.timestamps.published    = frame->timestamp;
+            const uint8_t *data = (const uint8_t*)(frame+1);
+            for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c)
+                memcpy(colors.channel(LedFrame::Channel(c)), data + c*size_t(header->numLeds), header->numLeds);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(frame->seq.load(std::memory_order_relaxed) != seq) continue;
+
+            return uint32_t(info.number) == index;
+        }
+    }
+
+    /**
+     * @brief Read the latest frame.
+     *
+     * @return true if a frame was read; false if none was published yet
+     */
+    bool readLatest(LedFrame &colors, FrameInfo &info) const {
+        while(true){
+            const uint32_t published = getPublished();
+            if(published == 0) return false;
+            if(read(published-1, colors, info)) return true;
+        }
+    }
+
+    /**
+     * @brief Report what a consumer did with a frame.
+     *
+     * Meant for the one consumer that drives the LEDs; if another consumer
+     * is reporting at the same time, or the writer gave up on this report
+     * because it took longer than FEEDBACK_TIMEOUT_NANOS, the report is
+     * dropped.
+     *
+     * @return true if the report was written
+     */
+    bool report(const Feedback &feedback){
+        uint32_t seq = header->feedbackSeq.load(std::memory_order_relaxed);
+        if(seq & 1) return false;
+        if(!header->feedbackSeq.compare_exchange_strong(seq, seq+1, std::memory_order_relaxed)) return false;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        header->feedbackNumber   = feedback.number;
+        header->feedbackReceived = feedback.received;
+        header->feedbackOutput   = feedback.output;
+
+        // Not a plain store, so as not to undo a reset by the writer
+        uint32_t odd = seq+1;
+        return header->feedbackSeq.compare_exchange_strong(odd, seq+2, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Read the latest report of a consumer, without blocking it.
+     *
+     * Meant for the writer, which calls it after every frame; a report
+     * that stays half-written for FEEDBACK_TIMEOUT_NANOS, e.g. because its
+     * consumer died, is abandoned so that the next consumer can report.
+     *
+     * @return true if a report was read; false if there is none yet, or a
+     *         consumer is writing one
+     */
+    bool readFeedback(Feedback &feedback){
+        const uint32_t seq = header->feedbackSeq.load(std::memory_order_acquire);
+        if(seq & 1){
+            recoverFeedback(seq);
+            return false;
+        }
+        stuckSeq = 0;
+        if(seq == 0) return false;
+
+        feedback.number   = header->feedbackNumber;
+        feedback.received = header->feedbackReceived;
+        feedback.output   = header->feedbackOutput;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header->feedbackSeq.load(std::memory_order_relaxed) == seq;
+    }
+};
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Conversion between sRGB-encoded channels and linear light, through
+ * lookup tables.
+ *
+ * Averaging sRGB bytes directly gives a result too dark (a region half
+ * black and half white averages to 128, which is about 22% of the light
+ * rather than 50%), and shifts the hue of mixed colours. Averaging in
+ * linear light and encoding the result back avoids this.
+ *
+ * Linear values have BITS bits, which is the least that keeps every byte
+ * distinct after decoding, so that a uniform region averages back to its
+ * own colour, while sums of up to 2^20 pixels still fit in 32 bits.
+ */
+namespace LinearLight {
+    const int BITS = 12;
+    const uint32_t MAX = (1u << BITS) - 1;
+
+    /// Linear value of each sRGB byte, from 0 to MAX
+    extern const uint16_t *const DECODE;
+
+    /// sRGB byte closest to each linear value from 0 to MAX
+    extern const uint8_t *const ENCODE;
+
+    inline uint32_t decode(uint32_t byte){ return DECODE[byte]; }
+
+    /**
+     * @brief sRGB byte of the average of n linear values.
+     *
+     * @param sum   Sum of the values
+     * @param n     Number of values; must be positive
+     */
+    inline uint8_t encodeAverage(uint32_t sum, uint32_t n){
+        const uint32_t v = uint32_t((uint64_t(sum) + n/2) / n);
+        return ENCODE[v < MAX ? v : MAX];
+    }
+}
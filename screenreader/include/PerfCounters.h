@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Hardware performance counters of the calling thread, through
+ * perf_event_open.
+ *
+ * The counters are opened as one group, so they are read together with a
+ * single system call and are scheduled on the PMU together. Counters the
+ * CPU or the kernel does not offer (e.g. in a container or a virtual
+ * machine, or with a restrictive kernel.perf_event_paranoid) are left out,
+ * and read as 0; isAvailable tells which ones are counted. Only user-space
+ * events are counted, as counting the kernel needs privileges.
+ *
+ * Only the thread that constructs the object is counted.
+ */
+class PerfCounters {
+public:
+    enum Counter {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        /// CPU time of the thread, in nanoseconds; a software counter, so
+        /// usually available even without a PMU
+        TASK_CLOCK,
+        NUM_COUNTERS
+    };
+
+private:
+    int leader;
+    int fds[NUM_COUNTERS];
+    /// Counter of each value of a group read, in the order opened
+    Counter order[NUM_COUNTERS];
+    int numOpen;
+    std::string error;
+
+public:
+    PerfCounters();
+
+    /**
+     * @brief Whether a counter is counted.
+     */
+    bool isAvailable(Counter counter) const;
+
+    /**
+     * @brief Whether any counter is counted.
+     */
+    bool isAvailable() const;
+
+    /**
+     * @brief Why the counters that are not available could not be opened,
+     * or an empty string.
+     */
+    const std::string &getError() const;
+
+    /**
+     * @brief Read the counts since construction, scaled up if the kernel had
+     * to multiplex the counters.
+     *
+     * @param values    Where to write the count of each counter; 0 for
+     *                  unavailable ones
+     */
+    void read(uint64_t values[NUM_COUNTERS]) const;
+
+    /**
+     * @brief Name of a counter, as used in reports, e.g. "cache_misses".
+     */
+    static const char *getName(Counter counter);
+
+    ~PerfCounters();
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "PerfCounters.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Performance counters of every stage of a frame, per frame and in
+ * aggregate.
+ *
+ * The thread that runs the frames calls beginFrame, endStage after each
+ * stage and endFrame; the counters are opened on its first frame, as they
+ * only count the thread that opens them. Work done by the worker pool is
+ * not counted.
+ *
+ * Every frame is written to a file as one line of JSON:
+ *
+ *   {"type":"frame","number":12,"capture":{"cycles":123,...},"reduce":{...},"publish":{...}}
+ *
+ * preceded by a line telling which counters are available, and followed,
+ * by writeTotals, by a line with the sums over all frames. Each stage has
+ * every counter of PerfCounters, under its name, with null for the ones that
+ * are unavailable, so the format does not depend on the machine.
+ */
+class PerfProfiler {
+public:
+    enum Stage {
+        /// Grabbing the regions of every display
+        CAPTURE,
+        /// Computing the colours of every LED
+        REDUCE,
+        /// Writing the colours to shared memory
+        PUBLISH,
+        NUM_STAGES
+    };
+
+    static const char *getStageName(Stage stage);
+
+    struct Totals {
+        uint64_t frames;
+        bool available[PerfCounters::NUM_COUNTERS];
+        uint64_t counts[NUM_STAGES][PerfCounters::NUM_COUNTERS];
+    };
+
+private:
+    std::string path;
+    FILE *file;
+
+    std::unique_ptr<PerfCounters> counters;
+    /// Set once the counters are open, after which available is constant
+    std::atomic<bool> opened;
+    bool available[PerfCounters::NUM_COUNTERS];
+
+    uint64_t last[PerfCounters::NUM_COUNTERS];
+    uint64_t frame[NUM_STAGES][PerfCounters::NUM_COUNTERS];
+
+    // Written by the frame thread only, read by any
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> totals[NUM_STAGES][PerfCounters::NUM_COUNTERS];
+
+    void open();
+    void writeStages(const uint64_t counts[NUM_STAGES][PerfCounters::NUM_COUNTERS]);
+
+public:
+    /**
+     * @brief Construct a new Perf Profiler object
+     *
+     * @param path_     File to write the JSON lines to, which is created or
+     *                  truncated
+     * @throws std::system_error if the file cannot be created
+     */
+    PerfProfiler(const std::string &path_);
+
+    /**
+     * @brief Start counting a frame.
+     */
+    void beginFrame();
+
+    /**
+     * @brief Attribute the counts since the end of the previous stage (or
+     * since beginFrame) to a stage.
+     */
+    void endStage(Stage stage);
+
+    /**
+     * @brief Write the counts of the frame, and add them to the totals.
+     *
+     * @param number    Number of the frame in the shared memory ring
+     */
+    void endFrame(uint64_t number);
+
+    Totals getTotals() const;
+
+    /**
+     * @brief Write the totals to the file; call once the frames are done.
+     */
+    void writeTotals();
+
+    ~PerfProfiler();
+};
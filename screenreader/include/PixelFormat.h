@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Layouts of the pixels a FrameSource can return.
+ *
+ * Each format has a PixelTraits specialization that decodes a pixel with
+ * shifts and masks known at compile time, so that loops templated on the
+ * format have no per-pixel branch. Code that handles any format picks the
+ * instantiation for the source's format once, when it is set up.
+ */
+enum PixelFormat {
+    /// 32-bit 0xAARRGGBB (BGRA in memory), with an undefined alpha channel
+    ARGB8888,
+    /// 32-bit 0xAABBGGRR (RGBA in memory), with an undefined alpha channel
+    ABGR8888,
+    /// 16-bit, with red in the top 5 bits and blue in the bottom 5
+    RGB565,
+    /// 16-bit, with blue in the top 5 bits and red in the bottom 5
+    BGR565,
+    NUM_PIXEL_FORMATS
+};
+
+template<PixelFormat F> struct PixelTraits;
+
+template<> struct PixelTraits<ARGB8888> {
+    typedef uint32_t Pixel;
+    /// Bits that hold colour; the others are padding or alpha
+    static const Pixel COLOR_MASK = 0x00ffffff;
+    static uint32_t red  (Pixel p){ return (p >> 16) & 0xff; }
+    static uint32_t green(Pixel p){ return (p >>  8) & 0xff; }
+    static uint32_t blue (Pixel p){ return (p      ) & 0xff; }
+    /// Pixel of 8-bit channels, with alpha set
+    static Pixel encode(uint32_t r, uint32_t g, uint32_t b){ return 0xff000000 | (r << 16) | (g << 8) | b; }
+};
+
+template<> struct PixelTraits<ABGR8888> {
+    typedef uint32_t Pixel;
+    static const Pixel COLOR_MASK = 0x00ffffff;
+    static uint32_t red  (Pixel p){ return (p      ) & 0xff; }
+    static uint32_t green(Pixel p){ return (p >>  8) & 0xff; }
+    static uint32_t blue (Pixel p){ return (p >> 16) & 0xff; }
+    static Pixel encode(uint32_t r, uint32_t g, uint32_t b){ return 0xff000000 | (b << 16) | (g << 8) | r; }
+};
+
+// 5 and 6-bit channels are widened by repeating their top bits, so that
+// the largest value maps to 255; encoding keeps their top bits
+template<> struct PixelTraits<RGB565> {
+    typedef uint16_t Pixel;
+    static const Pixel COLOR_MASK = 0xffff;
+    static uint32_t red  (Pixel p){ const uint32_t v = (p >> 11)       ; return (v << 3) | (v >> 2); }
+    static uint32_t green(Pixel p){ const uint32_t v = (p >>  5) & 0x3f; return (v << 2) | (v >> 4); }
+    static uint32_t blue (Pixel p){ const uint32_t v = (p      ) & 0x1f; return (v << 3) | (v >> 2); }
+    static Pixel encode(uint32_t r, uint32_t g, uint32_t b){ return Pixel(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)); }
+};
+
+template<> struct PixelTraits<BGR565> {
+    typedef uint16_t Pixel;
+    static const Pixel COLOR_MASK = 0xffff;
+    static uint32_t red  (Pixel p){ const uint32_t v = (p      ) & 0x1f; return (v << 3) | (v >> 2); }
+    static uint32_t green(Pixel p){ const uint32_t v = (p >>  5) & 0x3f; return (v << 2) | (v >> 4); }
+    static uint32_t blue (Pixel p){ const uint32_t v = (p >> 11)       ; return (v << 3) | (v >> 2); }
+    static Pixel encode(uint32_t r, uint32_t g, uint32_t b){ return Pixel(((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3)); }
+};
+
+/**
+ * @brief Convert a pixel to 0xffRRGGBB.
+ */
+template<PixelFormat F>
+inline uint32_t toARGB(typename PixelTraits<F>::Pixel p){
+    typedef PixelTraits<F> T;
+    return 0xff000000 | (T::red(p) << 16) | (T::green(p) << 8) | T::blue(p);
+}
+
+/**
+ * @brief Convert a 0xAARRGGBB pixel to format F, dropping the bits of each
+ * channel the format has no room for.
+ */
+template<PixelFormat F>
+inline typename PixelTraits<F>::Pixel fromARGB(uint32_t p){
+    return PixelTraits<F>::encode((p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff);
+}
+
+namespace PixelFormats {
+    int getBytesPerPixel(PixelFormat format);
+
+    const char *getName(PixelFormat format);
+
+    /**
+     * @brief Parse the name of a format, e.g. "rgb565".
+     *
+     * @throws std::invalid_argument if the name is unknown
+     */
+    PixelFormat parse(const std::string &name);
+
+    /**
+     * @brief Format of the pixels of an X visual.
+     *
+     * @param bitsPerPixel  Bits per pixel of images of the visual's depth
+     * @param redMask       Channel masks of the visual
+     * @param greenMask
+     * @param blueMask
+     * @throws std::invalid_argument if no format matches
+     */
+    PixelFormat fromMasks(int bitsPerPixel, uint32_t redMask, uint32_t greenMask, uint32_t blueMask);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "LedFrame.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Chooses the capture period from what is on the screen.
+ *
+ * After every frame, the governor compares the new LED colours with the
+ * previous ones. Fast motion raises the capture rate; a screen that stays
+ * still or black for a while, or a blanked display, drops it to a low-rate
+ * heartbeat that is just frequent enough to notice when things change.
+ */
+class RateGovernor {
+public:
+    enum State {
+        /// Fast motion; capture at the shortest period
+        FAST,
+        /// Capture at the normal period
+        NORMAL,
+        /// Still, black or blanked screen; capture at the idle period
+        IDLE,
+        NUM_STATES
+    };
+
+    struct Options {
+        /// Period while the screen shows fast motion
+        int64_t fastPeriodNanos   = 20000000;
+        /// Period otherwise
+        int64_t normalPeriodNanos = 50000000;
+        /// Period while the screen is idle
+        int64_t idlePeriodNanos   = 1000000000;
+        /// Average change of an LED channel, in levels (0-255) per normal
+        /// period, from which a frame counts as fast motion
+        double motionThreshold = 4.0;
+        /// Average change below which a frame counts as still
+        double stillThreshold = 0.5;
+        /// A frame counts as black if no LED channel is brighter than this
+        int blackLevel = 8;
+        /// Still or black frames in a row before the governor goes idle
+        int idleFrames = 20;
+    };
+
+    struct Stats {
+        /// Frames captured in each state
+        uint64_t frames[NUM_STATES];
+    };
+
+private:
+    Options options;
+    size_t numLeds;
+
+    LedFrame previous;
+    bool first;
+
+    State state;
+    int quietFrames;
+    Stats stats;
+
+    int64_t getPeriod() const;
+
+public:
+    RateGovernor(size_t numLeds_, const Options &options_);
+
+    /**
+     * @brief Account for a new frame.
+     *
+     * @param frame     LED colours of the frame, for numLeds LEDs
+     * @return int64_t  Period to capture the next frame after, in nanoseconds
+     */
+    int64_t update(const LedFrame &frame);
+
+    /**
+     * @brief Account for a frame not captured because the display is blanked.
+     *
+     * @return int64_t  Period to capture the next frame after, in nanoseconds
+     */
+    int64_t updateBlanked();
+
+    State getState() const;
+
+    Stats getStats() const;
+};
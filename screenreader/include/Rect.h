@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+
+/**
+ * @brief Axis-aligned rectangle in screen coordinates.
+ */
+struct Rect {
+    int x, y;
+    int width, height;
+
+    Rect(): x(0), y(0), width(0), height(0){}
+    Rect(int x_, int y_, int width_, int height_)
+        :x(x_),y(y_),width(width_),height(height_){}
+
+    int right () const { return x + width ; }
+    int bottom() const { return y + height; }
+
+    bool empty() const { return width <= 0 || height <= 0; }
+
+    /**
+     * @brief Intersection of two rectangles; empty if they do not overlap.
+     */
+    Rect intersect(const Rect &r) const {
+        const int x0 = std::max(x, r.x), x1 = std::min(right (), r.right ());
+        const int y0 = std::max(y, r.y), y1 = std::min(bottom(), r.bottom());
+        if(x0 >= x1 || y0 >= y1) return Rect(x0, y0, 0, 0);
+        return Rect(x0, y0, x1-x0, y1-y0);
+    }
+
+    /**
+     * @brief Smallest rectangle that contains both rectangles.
+     */
+    Rect unite(const Rect &r) const {
+        const int x0 = std::min(x, r.x), x1 = std::max(right (), r.right ());
+        const int y0 = std::min(y, r.y), y1 = std::max(bottom(), r.bottom());
+        return Rect(x0, y0, x1-x0, y1-y0);
+    }
+};
@@ -2,25 +2,146 @@
 
 #include "ScreenReader.h"
 #include "Color.h"
+#include "WorkerPool.h"
+
+#include <string>
+#include <vector>
 
 class ScreenProcessor {
+public:
+    enum Mode {
+        /// Average every pixel of the box on each call to getColor
+        DIRECT,
+        /// Build a summed-area table per strip on update, so that getColor
+        /// costs four lookups per strip regardless of the size of the box
+        SUMMED_AREA_TABLE
+    };
+
+private:
+    /**
+     * @brief Integral image of a strip.
+     *
+     * sums[((y*(width+1)) + x)*3 + c] is the sum of channel c over the
+     * pixels of the strip's span above and to the left of (x, y). Sums wrap around
+     * modulo 2^32; the sum of any box still comes out right, as long as it
+     * fits in 32 bits (i.e., boxes of up to 2^24 pixels, or 2^20 in linear
+     * light).
+     */
+    struct SummedAreaTable {
+        int width, height;
+        std::vector<uint32_t> sums;
+    };
+
+    /// Builds the tables of a range of strips, so that the pool can split them
+    class TableTask : public WorkerPool::Task {
+        ScreenProcessor &processor;
+    public:
+        TableTask(ScreenProcessor &processor_): processor(processor_){}
+        virtual void execute(size_t begin, size_t end);
+    };
+
     ScreenReader &reader;
+    WorkerPool *pool;
+    TableTask tableTask;
     int colorWidth;
     int colorHeight;
 
     int screenWidth;
     int screenHeight;
+
+    Mode mode;
+    bool linear;
+    SummedAreaTable tables[ScreenReader::NUM_STRIPS];
+
+    /// buildTable and getColorDirect for the format of the reader, and
+    /// whether to average in linear light
+    void (ScreenProcessor::*buildTableFunction)(ScreenReader::Strip strip);
+    Color<uint8_t> (ScreenProcessor::*getColorDirectFunction)(const Rect &region);
+
+    template<bool LINEAR>
+    void selectFunctions();
+
+    template<PixelFormat F, bool LINEAR>
+    void buildTable(ScreenReader::Strip strip);
+
+    template<PixelFormat F, bool LINEAR>
+    Color<uint8_t> getColorDirect(const Rect &region);
+    Color<uint8_t> getColorSummedAreaTable(const Rect &region);
+
 public:
+    /**
+     * @brief Construct a new Screen Processor object
+     *
+     * @param reader_       Reader to take pixels from
+     * @param colorWidth_   Size of the box getColor(x, y) averages
+     * @param colorHeight_
+     * @param mode_         How to average regions
+     * @param linear_       Average in linear light rather than on the
+     *                      sRGB-encoded values; see LinearLight
+     */
     ScreenProcessor(
         ScreenReader &reader_,
         int colorWidth_,
-        int colorHeight_
+        int colorHeight_,
+        Mode mode_ = DIRECT,
+        bool linear_ = false
     );
 
+    static Mode parseMode(const std::string &s);
+
+    /**
+     * @brief Build the summed-area tables of the strips in parallel.
+     *
+     * @param pool_     Pool to use, or nullptr to build them on the calling
+     *                  thread
+     */
+    void setPool(WorkerPool *pool_);
+
     int getWidth ();
     int getHeight();
 
+    /**
+     * @brief Average colour of the colorWidth x colorHeight box centered
+     * at (x, y).
+     */
     Color<uint8_t> getColor(const int x, const int y);
 
+    /**
+     * @brief Check that a region can be passed to getColor.
+     *
+     * @throws std::invalid_argument if the region is empty, not within the
+     * screen, not entirely covered by the strips of the ScreenReader, or
+     * contains none of the lines they capture
+     */
+    void validate(const Rect &region);
+
+    /**
+     * @brief Average colour of a region of the screen.
+     *
+     * Only the pixels the ScreenReader captured are averaged; if it skips
+     * lines, so does the average.
+     *
+     * The region is not validated; callers should check it once with
+     * validate rather than on every frame.
+     *
+     * @param region    Region to average
+     */
+    Color<uint8_t> getColor(const Rect &region);
+
+    /**
+     * @brief Whether the colour of a region may have changed in the last
+     * update; see ScreenReader::isChanged.
+     */
+    bool isChanged(const Rect &region) const;
+
+    /**
+     * @brief Capture a frame with the reader, and process it.
+     */
     void update();
+
+    /**
+     * @brief Process the frame the reader captured last, without capturing
+     * a new one; for callers that time capture and processing apart.
+     */
+    void updateTables();
 };
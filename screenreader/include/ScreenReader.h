@@ -1,50 +1,144 @@
 #pragma once
 
-#include <system_error>
-#include <sys/shm.h>
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/extensions/XShm.h>
+#include "FrameSource.h"
+#include "StripSpan.h"
+
+#include <cstdint>
+#include <vector>
 
 class ScreenReader {
-private:
-    static const int BITS_PER_PIXEL = 4;
+public:
+    enum Strip {
+        BOTTOM,
+        LEFT,
+        TOP,
+        RIGHT,
+        NUM_STRIPS
+    };
+
+    /// Size of the blocks strips are fingerprinted in: pixels along a
+    /// line, and lines
+    static const int BLOCK_PIXELS = 64;
+    static const int BLOCK_LINES  = 16;
 
 private:
+    /**
+     * @brief Fingerprints of the blocks of a strip's span, in row-major
+     * block order, and whether each changed in the last update.
+     */
+    struct Fingerprints {
+        int blocksX, blocksY;
+        std::vector<uint64_t> hashes;
+        std::vector<uint8_t> changed;
+        bool anyChanged;
+    };
+
+    FrameSource &source;
+    PixelFormat format;
+
     int MARGIN_X, MARGIN_Y;
+    int step;
 
-    XShmSegmentInfo shminfo_bot;
-    XShmSegmentInfo shminfo_lef;
-    XShmSegmentInfo shminfo_top;
-    XShmSegmentInfo shminfo_rig;
-    XImage *ximage_bot;
-    XImage *ximage_lef;
-    XImage *ximage_top;
-    XImage *ximage_rig;
-    unsigned int *data_bot;
-    unsigned int *data_lef;
-    unsigned int *data_top;
-    unsigned int *data_rig;
-    Display *dsp;
+    int handles[NUM_STRIPS];
+    StripSpan spans[NUM_STRIPS];
     int screenWidth, screenHeight;
 
+    bool changeDetection;
+    bool firstFingerprint;
+    Fingerprints fingerprints[NUM_STRIPS];
+
+    /// fingerprint<F> for the format of the source
+    void (ScreenReader::*fingerprintFunction)(Strip strip);
+
 private:
-    void initDisplay();
+    void initRegions();
 
-    unsigned int *createShm(int width, int height, XShmSegmentInfo &shminfo);
-    void initShm();
+    template<PixelFormat F>
+    void fingerprint(Strip strip);
 
-    void initXImage();
+    template<PixelFormat F>
+    static uint32_t decodePixel(const StripSpan &span, int x, int y);
 
 public:
-    ScreenReader(int NUM_LEDS_X, int NUM_LEDS_Y);
+    /**
+     * @brief Construct a new Screen Reader object
+     *
+     * @param source_       Source of screen contents
+     * @param NUM_LEDS_X    Number of LEDs along the top/bottom edges
+     * @param NUM_LEDS_Y    Number of LEDs along the left/right edges
+     * @param depth         If positive, capture at most this many pixels
+     *                      in from each edge
+     * @param step_         Capture only every step_-th line across the
+     *                      depth of each strip (rows of the top and bottom
+     *                      strips, columns of the left and right ones)
+     */
+    ScreenReader(FrameSource &source_, int NUM_LEDS_X, int NUM_LEDS_Y, int depth = 0, int step_ = 1);
 
     int getScreenWidth ();
     int getScreenHeight();
 
+    /**
+     * @brief Format of the pixels of the strips, that of the source.
+     */
+    PixelFormat getPixelFormat() const { return format; }
+
+    /**
+     * @brief Depth of the captured strips on the left/right and top/bottom
+     * edges.
+     */
+    int getMarginX() const { return MARGIN_X; }
+    int getMarginY() const { return MARGIN_Y; }
+
+    /**
+     * @brief Number of pixels copied from the screen on each update.
+     */
+    size_t getCapturedPixels() const;
+
+    /**
+     * @brief Number of bytes copied from the screen on each update.
+     */
+    size_t getCapturedBytes() const;
+
+    /**
+     * @brief Fingerprint every block of every strip on each update, so
+     * that isChanged can tell which parts of the screen changed.
+     *
+     * Costs about one extra read of the captured pixels per update.
+     */
+    void setChangeDetection(bool enabled);
+
     void update();
 
+    /**
+     * @brief Whether a region of the screen may have changed in the last
+     * update.
+     *
+     * Works at block granularity, so it may report a change next to a
+     * region that changed; always true if change detection is disabled.
+     *
+     * @param region    Region in screen coordinates
+     */
+    bool isChanged(const Rect &region) const;
+
+    /**
+     * @brief Whether any pixel of a strip may have changed in the last
+     * update; always true if change detection is disabled.
+     */
+    bool isChanged(Strip strip) const;
+
+    /**
+     * @brief Get a single pixel, as 0xffRRGGBB whatever the format.
+     *
+     * If lines are skipped, returns the pixel of the closest captured line
+     * before it. Validates its arguments on every call; prefer getStrip to
+     * read more than a few pixels.
+     */
     uint32_t getPixel(int x, int y);
 
-    ~ScreenReader();
+    /**
+     * @brief Get a strip, as captured by the last update.
+     *
+     * The span's pixels are only valid until the next update.
+     */
+    const StripSpan &getStrip(Strip strip) const { return spans[strip]; }
 };
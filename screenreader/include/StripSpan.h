@@ -0,0 +1,69 @@
+#pragma once
+
+#include "PixelFormat.h"
+#include "Rect.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Read-only view of the pixels of a captured strip.
+ *
+ * A span is made of lines of pixels: pixel (x, y) of the span is pixel x of
+ * line y, at data[y*stride + x]. Lines are screen rows, one every step rows
+ * starting at the top of rect; if the span is transposed, they are screen
+ * columns instead, one every step columns starting at the left of rect.
+ * With a step of 1 and no transposition, pixel (x, y) of the span shows
+ * screen position (rect.x + x, rect.y + y).
+ *
+ * Pixels are in the format of the frame source they were captured from;
+ * row<F>() must be called with that format.
+ */
+struct StripSpan {
+    const void *data;
+    PixelFormat format;
+    /// Pixels per line, and number of lines
+    int width, height;
+    /// Number of pixels from the start of a line to the start of the next
+    int stride;
+    /// Region of the screen the lines are sampled from
+    Rect rect;
+    /// Screen rows (or columns) from one line to the next
+    int step;
+    /// Whether lines are screen columns
+    bool transposed;
+
+    StripSpan(): data(nullptr), format(ARGB8888), width(0), height(0), stride(0), step(1), transposed(false){}
+
+    /**
+     * @brief Region of the screen this span covers.
+     */
+    Rect getRect() const { return rect; }
+
+    template<PixelFormat F>
+    const typename PixelTraits<F>::Pixel *row(int y) const {
+        return (const typename PixelTraits<F>::Pixel*)data + size_t(y)*stride;
+    }
+
+    /**
+     * @brief Clip a screen region to the pixels this span samples.
+     *
+     * @param region    Region in screen coordinates
+     * @return Rect     Sampled pixels inside the region, in span
+     *                  coordinates; empty if there are none
+     */
+    Rect clip(const Rect &region) const {
+        const Rect r = region.intersect(rect);
+        if(r.empty()) return Rect(0, 0, 0, 0);
+
+        // Pixels along a line, and lines (rounding up to the next sampled one)
+        const int x0 = (transposed ? r.y        - rect.y : r.x       - rect.x);
+        const int x1 = (transposed ? r.bottom() - rect.y : r.right() - rect.x);
+        const int l0 = (transposed ? r.x       - rect.x : r.y        - rect.y);
+        const int l1 = (transposed ? r.right() - rect.x : r.bottom() - rect.y);
+        const int y0 = (l0 + step-1) / step;
+        const int y1 = (l1 + step-1) / step;
+        if(y0 >= y1) return Rect(x0, y0, 0, 0);
+        return Rect(x0, y0, x1-x0, y1-y0);
+    }
+};
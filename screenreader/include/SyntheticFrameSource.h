@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FrameSource.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frame source that renders a test pattern, without needing an X server.
+ *
+ * Only the registered regions are rendered, so a frame costs about as much
+ * memory traffic as a real capture of the same regions. Patterns are
+ * rendered as ARGB8888 and, for other pixel formats, converted with
+ * fromARGB, so a pattern shows the same colours (up to the precision of the
+ * format) in every format.
+ */
+class SyntheticFrameSource : public FrameSource {
+public:
+    enum Pattern {
+        BLACK,      // All pixels black
+        STATIC,     // Gradient that never changes
+        GRADIENT,   // Gradient that scrolls every frame
+        NOISE       // Random pixels, different every frame
+    };
+
+private:
+    struct Region {
+        std::vector<Rect> parts;
+        std::vector<uint32_t> data;
+        /// data converted to the pixel format, unless it is ARGB8888; in
+        /// words, to keep pixels aligned
+        std::vector<uint32_t> converted;
+    };
+
+    int screenWidth, screenHeight;
+    Pattern pattern;
+    PixelFormat format;
+    uint64_t frame;
+
+    std::vector<Region> regions;
+
+    void render(const Rect &rect, uint32_t *p);
+    void render(Region &region);
+
+    template<PixelFormat F>
+    static void convert(Region &region);
+
+public:
+    SyntheticFrameSource(int screenWidth_, int screenHeight_, Pattern pattern_ = GRADIENT, PixelFormat format_ = ARGB8888);
+
+    static Pattern parsePattern(const std::string &s);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+};
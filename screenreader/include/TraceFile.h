@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Layout of the trace files written by TraceRecorder and replayed
+ * by TraceFrameSource.
+ *
+ * A trace holds the regions a FrameSource captured, frame after frame. It
+ * starts with a Header, followed by one PartRecord for every part of every
+ * region, in the order the regions were registered, then by the frames.
+ * Each frame is a FrameHeader followed by the pixels of every region, as
+ * getRegion returned them; the header and each region are padded to
+ * ALIGNMENT bytes, so that a frame has a fixed size and every region of a
+ * mapped trace is aligned like a captured one.
+ *
+ * A trace cut short (e.g. because the recorder was killed) is still valid:
+ * a trailing partial frame is ignored.
+ *
+ * All fields are little-endian, at fixed offsets.
+ */
+namespace TraceFile {
+
+const char MAGIC[8] = {'L', 'E', 'D', 'T', 'R', 'A', 'C', 'E'};
+const uint32_t VERSION = 1;
+
+const size_t ALIGNMENT = 64;
+
+struct Header {
+    char magic[8];              //  0
+    uint32_t version;           //  8
+    uint32_t headerSize;        // 12, offset of the first frame
+    int32_t screenWidth;        // 16
+    int32_t screenHeight;       // 20
+    uint32_t pixelFormat;       // 24, a PixelFormat
+    uint32_t numRegions;        // 28
+    uint32_t numParts;          // 32, PartRecords following the Header
+    uint32_t frameSize;         // 36
+    uint32_t reserved[6];       // 40
+};
+
+struct PartRecord {
+    uint32_t region;            //  0, handle of the region the part belongs to
+    int32_t x, y;               //  4
+    int32_t width, height;      // 12
+};
+
+struct FrameHeader {
+    uint64_t number;            //  0, index of the frame since recording started
+    uint64_t captureStart;      //  8, CLOCK_MONOTONIC nanoseconds when the grab started
+    uint64_t captureEnd;        // 16, and when it ended
+    uint64_t reserved[5];       // 24
+};
+
+static_assert(sizeof(Header) == 64, "TraceFile::Header must be 64 bytes");
+static_assert(sizeof(PartRecord) == 20, "TraceFile::PartRecord must be 20 bytes");
+static_assert(sizeof(FrameHeader) == ALIGNMENT, "TraceFile::FrameHeader must be one alignment unit");
+
+inline size_t align(size_t size){
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+inline size_t getHeaderSize(uint32_t numParts){
+    return align(sizeof(Header) + size_t(numParts) * sizeof(PartRecord));
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "FrameSource.h"
+#include "TraceFile.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frame source that replays a trace written by TraceRecorder.
+ *
+ * The trace is mapped into memory and getRegion returns pointers into the
+ * mapping, so replaying a frame copies nothing: the reader's strips point
+ * straight at the recorded pixels. Playback loops when the end of the trace
+ * is reached.
+ *
+ * Screen size and pixel format are those of the recording, and only the
+ * recorded regions can be registered, which means the trace has to be
+ * replayed with the layout, --depth and --step it was recorded with.
+ */
+class TraceFrameSource : public FrameSource {
+private:
+    struct Region {
+        std::vector<Rect> parts;
+        /// Offset of the pixels within a frame
+        size_t offset;
+        bool registered;
+    };
+
+    int fd;
+    const uint8_t *file;
+    size_t fileSize;
+
+    TraceFile::Header header;
+    std::vector<Region> regions;
+    /// Recorded region of each handle
+    std::vector<int> handles;
+
+    size_t numFrames;
+    size_t frame;
+    const uint8_t *current;
+
+    void parse(const std::string &path);
+
+public:
+    /**
+     * @brief Construct a new Trace Frame Source object
+     *
+     * @param path  Trace file
+     * @throws std::system_error if the file cannot be read
+     * @throws std::invalid_argument if it is not a valid trace
+     */
+    TraceFrameSource(const std::string &path);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    /**
+     * @throws std::invalid_argument if no recorded region, not already
+     * registered, has these parts
+     */
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+
+    /**
+     * @brief Number of frames in the trace.
+     */
+    size_t getNumFrames() const;
+
+    /**
+     * @brief Time between the starts of the first and last recorded
+     * captures, in nanoseconds.
+     */
+    uint64_t getDurationNanos() const;
+
+    /**
+     * @brief Header of the frame returned by the last grab, which holds
+     * when it was originally captured.
+     */
+    const TraceFile::FrameHeader &getFrameHeader() const;
+
+    virtual ~TraceFrameSource();
+};
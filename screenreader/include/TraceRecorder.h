@@ -0,0 +1,77 @@
+#pragma once
+
+#include "FrameSource.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frame source that passes another source through, appending every
+ * frame it grabs to a trace file; see TraceFile.
+ *
+ * The trace holds exactly what the reader saw: the pixels of the registered
+ * regions, in the source's own format, plus the time each grab started and
+ * ended. TraceFrameSource replays it.
+ *
+ * The file header is written on the first grab, once every region is known.
+ * Each frame is appended with a single writev, so recording costs a copy of
+ * the captured regions into the page cache. If a write fails (e.g. the disk
+ * is full), recording stops with a message and the source carries on.
+ */
+class TraceRecorder : public FrameSource {
+private:
+    struct Region {
+        std::vector<Rect> parts;
+        /// Bytes of pixels, and of padding after them
+        size_t size, padding;
+    };
+
+    std::unique_ptr<FrameSource> source;
+    std::string path;
+    int fd;
+
+    std::vector<Region> regions;
+    size_t frameSize;
+    uint64_t frames;
+    bool started;
+
+    bool writeAll(const struct iovec *iov, int count, size_t size);
+    void writeHeader();
+    void writeFrame(uint64_t captureStart, uint64_t captureEnd);
+    void stop(const char *what);
+
+public:
+    /**
+     * @brief Construct a new Trace Recorder object
+     *
+     * @param source_   Source to record; the recorder takes ownership of
+     *                  it, even if construction fails
+     * @param path_     Trace file, which is created or truncated
+     * @throws std::system_error if the file cannot be created
+     */
+    TraceRecorder(FrameSource *source_, const std::string &path_);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    /**
+     * @throws std::logic_error once recording has started
+     */
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+
+    virtual bool isBlanked();
+
+    /**
+     * @brief Number of frames written so far.
+     */
+    uint64_t getNumFrames() const;
+
+    virtual ~TraceRecorder();
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent pool of threads that split a range of work items.
+ *
+ * Threads are created once, and sleep on a futex between jobs, so a job
+ * costs one wake-up system call rather than thread creation. The calling
+ * thread takes part in every job.
+ *
+ * The items of a job are divided evenly between threads up front; each
+ * thread takes chunks from its own share and, once it runs out, steals
+ * chunks from the shares of the others, so a thread that got the expensive
+ * items does not hold up the job.
+ */
+class WorkerPool {
+public:
+    class Task {
+    public:
+        /**
+         * @brief Process items [begin, end). Called concurrently from
+         * several threads, with disjoint ranges.
+         */
+        virtual void execute(size_t begin, size_t end) = 0;
+        virtual ~Task(){}
+    };
+
+private:
+    /// Iterations to spin before sleeping on a futex, when waiting for a
+    /// job or for a job to finish
+    static const int SPIN_ITERATIONS = 4000;
+
+    /// Share of the items of a thread; each has a cache line to itself, so
+    /// that threads taking chunks from their own share, and thieves taking
+    /// chunks from another, do not write to the same line. The vector
+    /// honours the alignment since C++17.
+    struct alignas(64) Range {
+        std::atomic<size_t> next;
+        size_t end;
+    };
+    static_assert(sizeof(Range) == 64, "Range must fill one cache line");
+
+    int numThreads;
+    std::vector<std::thread> threads;
+    std::vector<Range> ranges;
+
+    Task *task;
+    size_t grain;
+
+    /// Incremented to start a job; a futex workers wait on
+    std::atomic<uint32_t> generation;
+    /// Workers still running the current job; a futex the caller waits on
+    std::atomic<uint32_t> remaining;
+    std::atomic<bool> stopping;
+
+    void work(int self);
+    void loop(int self);
+
+public:
+    /**
+     * @param numThreads_   Threads taking part in each job, including the
+     *                      calling thread; 1 runs every job inline
+     */
+    WorkerPool(int numThreads_);
+
+    int getNumThreads() const;
+
+    /**
+     * @brief Run a task over items [0, numItems), and wait for it to finish.
+     *
+     * @param task_     Task to run
+     * @param numItems  Number of items
+     * @param grain_    Items taken at a time, or 0 to choose automatically
+     */
+    void run(Task &task_, size_t numItems, size_t grain_ = 0);
+
+    ~WorkerPool();
+};
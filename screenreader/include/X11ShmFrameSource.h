@@ -0,0 +1,90 @@
+#pragma once
+
+#include "FrameSource.h"
+
+#include <deque>
+#include <vector>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+/**
+ * @brief Frame source that reads the root window of an X server using the
+ * MIT-SHM extension.
+ *
+ * Pixels are captured in the format of the default visual, so 16-bit
+ * displays need half the bytes of 32-bit ones; see PixelFormat for the
+ * visuals supported.
+ *
+ * XShmGetImage waits for the server to reply, so each region is captured
+ * with a single request, whatever its number of parts: a region of several
+ * parts (e.g. every fourth row of a strip) is captured as the rectangle
+ * that bounds them, and its parts are then copied out of it. This copies
+ * more pixels, but costs one round trip per region rather than per part.
+ * Parts are also copied out of a region of a single part whose rows the
+ * server pads, e.g. an odd width at 16 bits per pixel.
+ */
+class X11ShmFrameSource : public FrameSource {
+    /**
+     * @brief Region captured into a segment with one XImage, of the
+     * rectangle that bounds its parts.
+     */
+    struct Region {
+        std::vector<Rect> parts;
+        Rect bounds;
+        XShmSegmentInfo shminfo;
+        XImage *ximage;
+        /// The parts copied one after the other out of the segment, without
+        /// row padding; empty if the segment can be returned as it is
+        std::vector<uint8_t> packed;
+        /// The segment with a single, unpadded part; packed otherwise
+        uint8_t *data;
+    };
+
+private:
+    Display *dsp;
+    int screenWidth, screenHeight;
+    PixelFormat format;
+    int bytesPerPixel;
+    /// Whether the server supports DPMS, so isBlanked can ask it
+    bool dpms;
+
+    // std::deque keeps references stable; XImages point to their shminfo
+    std::deque<Region> regions;
+
+private:
+    void initDisplay(const char *displayName);
+
+    /**
+     * @brief Find the pixel format of the default visual.
+     *
+     * @throws std::invalid_argument if it is not supported
+     */
+    void initPixelFormat();
+
+    uint8_t *createShm(size_t numPixels, XShmSegmentInfo &shminfo);
+
+public:
+    /**
+     * @brief Construct a new X11 SHM frame source
+     *
+     * @param displayName   Name of the X display, or NULL to use $DISPLAY
+     */
+    X11ShmFrameSource(const char *displayName = NULL);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+
+    virtual bool isBlanked();
+
+    virtual ~X11ShmFrameSource();
+};
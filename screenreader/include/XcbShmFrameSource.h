@@ -0,0 +1,107 @@
+#pragma once
+
+#include "FrameSource.h"
+
+#include <deque>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+/**
+ * @brief Frame source that reads the root window of an X server through
+ * xcb-shm, with the requests for a frame pipelined behind the processing
+ * of the previous one.
+ *
+ * Every region is double-buffered. grab() collects the replies for the
+ * buffer requested during the previous grab, then immediately requests the
+ * next frame into the other buffer and returns; the X server copies that
+ * frame while the caller processes this one, and the round trips for all
+ * regions overlap. As a consequence, the pixels returned by a grab were
+ * captured when the previous grab returned, up to one frame earlier than
+ * with X11ShmFrameSource, and the pointers returned by getRegion alternate
+ * between two buffers.
+ *
+ * Pipelining only pays off while grabs follow each other closely: a frame
+ * requested more than MAX_PIPELINED_AGE_NANOS before the grab that
+ * collects it, e.g. at the idle rate of RateGovernor, is dropped, and a
+ * current one is captured and waited for instead.
+ *
+ * The server pads each row of an image, e.g. to 32 bits, so the rows of a
+ * part whose width is not a multiple of that (an odd width at 16 bits per
+ * pixel, or a column one pixel wide) are copied out of the buffer after
+ * every grab.
+ */
+class XcbShmFrameSource : public FrameSource {
+private:
+    static const int NUM_BUFFERS = 2;
+    /// Oldest pipelined frame a grab returns; covers the normal and fast
+    /// capture periods, but not the idle one
+    static const uint64_t MAX_PIPELINED_AGE_NANOS = 100000000;
+
+    /**
+     * @brief Region captured into one segment, holding one buffer after
+     * the other.
+     */
+    struct Region {
+        std::vector<Rect> parts;
+        /// Bytes of one buffer, with the rows of each part padded
+        size_t bufferBytes;
+        int shmid;
+        xcb_shm_seg_t shmseg;
+        uint8_t *data;
+        /// The parts of the current buffer without row padding, if any
+        /// part has padded rows; empty otherwise
+        std::vector<uint8_t> packed;
+        /// Requests in flight, one per part
+        std::vector<xcb_shm_get_image_cookie_t> cookies;
+    };
+
+private:
+    xcb_connection_t *connection;
+    xcb_window_t root;
+    int screenWidth, screenHeight;
+    PixelFormat format;
+    int bytesPerPixel;
+    /// Multiple of bytes the server pads each row of an image to
+    int scanlinePadBytes;
+
+    std::deque<Region> regions;
+
+    /// Buffer returned by getRegion, and whether requests for the other
+    /// one are in flight
+    int current;
+    bool pending;
+    /// CLOCK_MONOTONIC nanoseconds when the requests in flight were sent
+    uint64_t requestTime;
+
+private:
+    /**
+     * @brief Bytes from one row of a part to the next, as the server
+     * writes them.
+     */
+    size_t getStride(const Rect &rect) const;
+
+    void request(int buffer);
+    void wait();
+
+public:
+    /**
+     * @brief Construct a new xcb-shm frame source
+     *
+     * @param displayName   Name of the X display, or NULL to use $DISPLAY
+     */
+    XcbShmFrameSource(const char *displayName = NULL);
+
+    virtual int getScreenWidth ();
+    virtual int getScreenHeight();
+    virtual PixelFormat getPixelFormat();
+
+    using FrameSource::addRegion;
+    virtual int addRegion(const std::vector<Rect> &parts);
+
+    virtual void grab();
+
+    virtual const void *getRegion(int handle);
+
+    virtual ~XcbShmFrameSource();
+};
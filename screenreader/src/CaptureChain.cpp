@@ -0,0 +1,56 @@
+#include "CaptureChain.h"
+
+CaptureChain::CaptureChain(FrameSource *source_, const LedLayout &layout_, const Options &options):
+    source(source_),
+    layout(layout_),
+    reader(*source, layout.getCellsX(), layout.getCellsY(), options.depth, options.step),
+    processor(
+        reader,
+        reader.getScreenWidth () / layout.getCellsX(),
+        reader.getScreenHeight() / layout.getCellsY(),
+        options.reduction,
+        options.linear
+    ),
+    ledProcessor(processor, layout, options.depth, options.sampling),
+    captured(false)
+{
+    reader.setChangeDetection(options.incremental);
+
+    for(const LedLayout::Slot &slot: layout.getSlots(reader.getScreenWidth(), reader.getScreenHeight()))
+        edges.push_back(slot.edge);
+}
+
+size_t CaptureChain::getNumLeds() const {
+    return ledProcessor.getNumLeds();
+}
+
+const std::vector<LedLayout::Edge> &CaptureChain::getEdges() const {
+    return edges;
+}
+
+void CaptureChain::setPool(WorkerPool *pool){
+    processor.setPool(pool);
+    ledProcessor.setPool(pool);
+}
+
+bool CaptureChain::update(LedFrame &dest, size_t offset){
+    capture();
+    reduce(dest, offset);
+    return captured;
+}
+
+bool CaptureChain::capture(){
+    captured = !source->isBlanked();
+    if(captured) reader.update();
+    return captured;
+}
+
+void CaptureChain::reduce(LedFrame &dest, size_t offset){
+    if(!captured){
+        dest.clear(offset, getNumLeds());
+        return;
+    }
+
+    processor.updateTables();
+    ledProcessor.copy(dest, offset);
+}
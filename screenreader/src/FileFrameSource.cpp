@@ -0,0 +1,104 @@
+#include "FileFrameSource.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+FileFrameSource::FileFrameSource(const std::string &path, int screenWidth_, int screenHeight_, PixelFormat format_):
+    screenWidth (screenWidth_ ),
+    screenHeight(screenHeight_),
+    format(format_),
+    bytesPerPixel(PixelFormats::getBytesPerPixel(format)),
+    fd(-1),
+    file(nullptr),
+    fileSize(0),
+    numFrames(0),
+    frame(0)
+{
+    if(screenWidth <= 0 || screenHeight <= 0)
+        throw std::invalid_argument("Screen size must be positive");
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not open frame file " + path
+        );
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        std::error_code ec(errno, std::system_category());
+        close(fd);
+        throw std::system_error(ec, "Could not stat frame file " + path);
+    }
+    fileSize = st.st_size;
+
+    const size_t frameSize = size_t(screenWidth) * screenHeight * bytesPerPixel;
+    numFrames = fileSize / frameSize;
+    if(numFrames == 0){
+        close(fd);
+        throw std::invalid_argument("Frame file " + path + " is smaller than one frame");
+    }
+
+    void *p = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED){
+        std::error_code ec(errno, std::system_category());
+        close(fd);
+        throw std::system_error(ec, "Could not map frame file " + path);
+    }
+    file = (const uint8_t *)p;
+}
+
+int FileFrameSource::getScreenWidth (){ return screenWidth ; }
+int FileFrameSource::getScreenHeight(){ return screenHeight; }
+PixelFormat FileFrameSource::getPixelFormat(){ return format; }
+
+int FileFrameSource::addRegion(const std::vector<Rect> &parts){
+    size_t size = 0;
+    for(const Rect &rect: parts){
+        if(
+            rect.x < 0 || rect.right () > screenWidth  ||
+            rect.y < 0 || rect.bottom() > screenHeight ||
+            rect.empty()
+        ) throw std::invalid_argument("Region must be non-empty and within screen bounds");
+        size += size_t(rect.width) * rect.height;
+    }
+
+    Region region;
+    region.parts = parts;
+    region.data.resize(size * bytesPerPixel);
+    copy(region);
+    regions.push_back(region);
+    return regions.size()-1;
+}
+
+void FileFrameSource::copy(Region &region){
+    const size_t lineSize = size_t(screenWidth) * bytesPerPixel;
+    const uint8_t *src = file + frame * screenHeight * lineSize;
+    uint8_t *dest = region.data.data();
+    for(const Rect &rect: region.parts){
+        for(int y = rect.y; y < rect.bottom(); ++y){
+            memcpy(dest, src + y * lineSize + size_t(rect.x) * bytesPerPixel, size_t(rect.width) * bytesPerPixel);
+            dest += size_t(rect.width) * bytesPerPixel;
+        }
+    }
+}
+
+void FileFrameSource::grab(){
+    frame = (frame + 1) % numFrames;
+    for(Region &region: regions) copy(region);
+}
+
+const void *FileFrameSource::getRegion(int handle){
+    return regions.at(handle).data.data();
+}
+
+FileFrameSource::~FileFrameSource(){
+    if(file) munmap((void*)file, fileSize);
+    if(fd != -1) close(fd);
+}
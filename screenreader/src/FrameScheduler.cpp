@@ -0,0 +1,130 @@
+#include "FrameScheduler.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <time.h>
+
+namespace {
+const int64_t SECONDS_TO_NANOS = 1000000000;
+
+int64_t toNanos(const timespec &ts){
+    return int64_t(ts.tv_sec)*SECONDS_TO_NANOS + ts.tv_nsec;
+}
+
+timespec toTimespec(int64_t ns){
+    timespec ts;
+    ts.tv_sec  = ns / SECONDS_TO_NANOS;
+    ts.tv_nsec = ns % SECONDS_TO_NANOS;
+    return ts;
+}
+
+int64_t now(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return toNanos(ts);
+}
+}
+
+FrameScheduler::FrameScheduler(AlarmTask &task_, const Options &options_):
+    task(task_),
+    options(options_),
+    periodNanos(options_.periodNanos),
+    running(false),
+    frames(0),
+    missedDeadlines(0),
+    skippedFrames(0),
+    failedFrames(0),
+    maxFrameNanos(0)
+{}
+
+void FrameScheduler::setupThread(){
+    if(options.priority > 0){
+        sched_param param;
+        param.sched_priority = options.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err != 0) fprintf(stderr, "[SCHEDULER] Could not set SCHED_FIFO priority %d: %s\n", options.priority, strerror(err));
+    }
+
+    if(options.cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(options.cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(err != 0) fprintf(stderr, "[SCHEDULER] Could not pin capture thread to CPU %d: %s\n", options.cpu, strerror(err));
+    }
+}
+
+void FrameScheduler::run(){
+    setupThread();
+
+    int64_t next = now();
+    while(running.load(std::memory_order_relaxed)){
+        next += periodNanos.load(std::memory_order_relaxed);
+        const timespec deadline = toTimespec(next);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+
+        if(!running.load(std::memory_order_relaxed)) break;
+
+        try {
+            task.execute();
+        } catch(const std::runtime_error &e){
+            // Report the first failure only; the rest are counted, as an
+            // X server that went away fails every frame
+            if(failedFrames.fetch_add(1, std::memory_order_relaxed) == 0)
+                fprintf(stderr, "[SCHEDULER] Frame failed, skipping: %s\n", e.what());
+        }
+        frames.fetch_add(1, std::memory_order_relaxed);
+
+        const int64_t elapsed = now() - next;
+        if(elapsed > maxFrameNanos.load(std::memory_order_relaxed))
+            maxFrameNanos.store(elapsed, std::memory_order_relaxed);
+
+        // If the frame overran into the next period(s), those frames can
+        // no longer start on time; skip them and resume at the next
+        // deadline still in the future
+        const int64_t period = periodNanos.load(std::memory_order_relaxed);
+        if(elapsed >= period){
+            const int64_t skip = elapsed / period;
+            missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+            skippedFrames.fetch_add(skip, std::memory_order_relaxed);
+            next += skip * period;
+        }
+    }
+}
+
+void FrameScheduler::start(){
+    if(options.lockMemory){
+        if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0) perror("[SCHEDULER] Could not lock memory");
+    }
+
+    running = true;
+    thread = std::thread(&FrameScheduler::run, this);
+}
+
+void FrameScheduler::stop(){
+    running = false;
+    if(thread.joinable()) thread.join();
+}
+
+void FrameScheduler::setPeriod(int64_t periodNanos_){
+    periodNanos.store(periodNanos_, std::memory_order_relaxed);
+}
+
+FrameScheduler::Stats FrameScheduler::getStats() const {
+    Stats stats;
+    stats.frames          = frames         .load(std::memory_order_relaxed);
+    stats.missedDeadlines = missedDeadlines.load(std::memory_order_relaxed);
+    stats.skippedFrames   = skippedFrames  .load(std::memory_order_relaxed);
+    stats.failedFrames    = failedFrames   .load(std::memory_order_relaxed);
+    stats.maxFrameNanos   = maxFrameNanos  .load(std::memory_order_relaxed);
+    return stats;
+}
+
+FrameScheduler::~FrameScheduler(){
+    stop();
+}
@@ -0,0 +1,176 @@
+#include "Kernels.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+
+namespace {
+
+void sumRowScalar(const uint32_t *row, int n, uint32_t sums[3]){
+    uint32_t r = 0, g = 0, b = 0;
+    for(int i = 0; i < n; ++i){
+        const uint32_t p = row[i];
+        r += (p >> 16) & 0xFF;
+        g += (p >>  8) & 0xFF;
+        b += (p      ) & 0xFF;
+    }
+    sums[0] += r;
+    sums[1] += g;
+    sums[2] += b;
+}
+
+#if defined(KERNELS_X86) && defined(__SSE2__)
+#define KERNELS_SSE2
+void sumRowSSE2(const uint32_t *row, int n, uint32_t sums[3]){
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc32 = zero; // B, G, R, A
+    int i = 0;
+    while(n - i >= 4){
+        // Each iteration adds at most 2*255 to each 16-bit lane,
+        // so 128 iterations fit before widening to 32 bits
+        const int end = i + 4*std::min((n - i)/4, 128);
+        __m128i acc16 = zero;
+        for(; i < end; i += 4){
+            const __m128i p = _mm_loadu_si128((const __m128i*)(row + i));
+            acc16 = _mm_add_epi16(acc16, _mm_add_epi16(
+                _mm_unpacklo_epi8(p, zero),
+                _mm_unpackhi_epi8(p, zero)
+            ));
+        }
+        acc32 = _mm_add_epi32(acc32, _mm_unpacklo_epi16(acc16, zero));
+        acc32 = _mm_add_epi32(acc32, _mm_unpackhi_epi16(acc16, zero));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc32);
+    sums[0] += lanes[2];
+    sums[1] += lanes[1];
+    sums[2] += lanes[0];
+    sumRowScalar(row + i, n - i, sums);
+}
+
+__attribute__((target("avx2")))
+void sumRowAVX2(const uint32_t *row, int n, uint32_t sums[3]){
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc32 = zero; // B, G, R, A, twice
+    int i = 0;
+    while(n - i >= 8){
+        const int end = i + 8*std::min((n - i)/8, 128);
+        __m256i acc16 = zero;
+        for(; i < end; i += 8){
+            const __m256i p = _mm256_loadu_si256((const __m256i*)(row + i));
+            acc16 = _mm256_add_epi16(acc16, _mm256_add_epi16(
+                _mm256_unpacklo_epi8(p, zero),
+                _mm256_unpackhi_epi8(p, zero)
+            ));
+        }
+        acc32 = _mm256_add_epi32(acc32, _mm256_unpacklo_epi16(acc16, zero));
+        acc32 = _mm256_add_epi32(acc32, _mm256_unpackhi_epi16(acc16, zero));
+    }
+    const __m128i acc = _mm_add_epi32(
+        _mm256_castsi256_si128(acc32),
+        _mm256_extracti128_si256(acc32, 1)
+    );
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    sums[0] += lanes[2];
+    sums[1] += lanes[1];
+    sums[2] += lanes[0];
+    sumRowSSE2(row + i, n - i, sums);
+}
+#endif
+
+#if defined(KERNELS_NEON)
+inline uint32_t horizontalAdd(uint32x4_t v){
+    const uint64x2_t s = vpaddlq_u32(v);
+    return uint32_t(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+}
+
+void sumRowNEON(const uint32_t *row, int n, uint32_t sums[3]){
+    uint32x4_t accB = vdupq_n_u32(0), accG = accB, accR = accB;
+    int i = 0;
+    while(n - i >= 16){
+        // Each iteration adds at most 2*255 to each 16-bit lane
+        const int end = i + 16*std::min((n - i)/16, 128);
+        uint16x8_t b16 = vdupq_n_u16(0), g16 = b16, r16 = b16;
+        for(; i < end; i += 16){
+            const uint8x16x4_t p = vld4q_u8((const uint8_t*)(row + i));
+            b16 = vpadalq_u8(b16, p.val[0]);
+            g16 = vpadalq_u8(g16, p.val[1]);
+            r16 = vpadalq_u8(r16, p.val[2]);
+        }
+        accB = vpadalq_u16(accB, b16);
+        accG = vpadalq_u16(accG, g16);
+        accR = vpadalq_u16(accR, r16);
+    }
+    sums[0] += horizontalAdd(accR);
+    sums[1] += horizontalAdd(accG);
+    sums[2] += horizontalAdd(accB);
+    sumRowScalar(row + i, n - i, sums);
+}
+#endif
+
+struct Implementation {
+    const char *name;
+    Kernels::SumRowFunction sumRow;
+};
+
+bool isSupported(const std::string &name){
+    if(name == "scalar") return true;
+#if defined(KERNELS_SSE2)
+    if(name == "sse2") return true;
+    if(name == "avx2") return __builtin_cpu_supports("avx2");
+#endif
+#if defined(KERNELS_NEON)
+    if(name == "neon") return true;
+#endif
+    return false;
+}
+
+const Implementation IMPLEMENTATIONS[] = {
+    // Fastest first
+#if defined(KERNELS_SSE2)
+    {"avx2"  , sumRowAVX2  },
+    {"sse2"  , sumRowSSE2  },
+#endif
+#if defined(KERNELS_NEON)
+    {"neon"  , sumRowNEON  },
+#endif
+    {"scalar", sumRowScalar}
+};
+
+const Implementation *current = nullptr;
+
+const Implementation *select(){
+    for(const Implementation &impl: IMPLEMENTATIONS){
+        if(isSupported(impl.name)) return &impl;
+    }
+    throw std::logic_error("The scalar implementation is always supported");
+}
+
+}
+
+Kernels::SumRowFunction Kernels::sumRow = (current = select())->sumRow;
+
+const char *Kernels::getImplementation(){
+    return current->name;
+}
+
+void Kernels::setImplementation(const std::string &name){
+    for(const Implementation &impl: IMPLEMENTATIONS){
+        if(impl.name == name && isSupported(impl.name)){
+            current = &impl;
+            sumRow = impl.sumRow;
+            return;
+        }
+    }
+    throw std::invalid_argument("Kernel implementation '" + name + "' is not available on this machine");
+}
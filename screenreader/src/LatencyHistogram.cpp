@@ -0,0 +1,66 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+LatencyHistogram::LatencyHistogram():
+    counts(NUM_BUCKETS),
+    count(0),
+    min(std::numeric_limits<int64_t>::max()),
+    max(0),
+    sum(0)
+{
+    for(std::atomic<uint64_t> &c: counts) c.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::getBucket(int64_t value){
+    if(value < SUB_COUNT) return int(value);
+    // value >> shift is in [SUB_COUNT, 2*SUB_COUNT)
+    const int shift = 63 - __builtin_clzll(uint64_t(value)) - SUB_BITS;
+    return (shift+1)*SUB_COUNT + int(value >> shift) - SUB_COUNT;
+}
+
+int64_t LatencyHistogram::getBucketEnd(int bucket){
+    if(bucket < SUB_COUNT) return bucket;
+    const int shift = bucket/SUB_COUNT - 1;
+    const int64_t sub = bucket%SUB_COUNT + SUB_COUNT;
+    return ((sub+1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t nanos){
+    nanos = std::max<int64_t>(0, std::min(nanos, MAX_VALUE));
+
+    // Only one thread records, so plain loads and stores are enough
+    std::atomic<uint64_t> &c = counts[getBucket(nanos)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum  .store(sum  .load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+    if(nanos < min.load(std::memory_order_relaxed)) min.store(nanos, std::memory_order_relaxed);
+    if(nanos > max.load(std::memory_order_relaxed)) max.store(nanos, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const {
+    Snapshot s;
+    s.counts.resize(NUM_BUCKETS);
+    s.count = 0;
+    for(int i = 0; i < NUM_BUCKETS; ++i){
+        s.counts[i] = counts[i].load(std::memory_order_relaxed);
+        s.count += s.counts[i];
+    }
+    s.min  = (s.count ? min.load(std::memory_order_relaxed) : 0);
+    s.max  = max.load(std::memory_order_relaxed);
+    s.mean = (s.count ? double(sum.load(std::memory_order_relaxed)) / count.load(std::memory_order_relaxed) : 0);
+    return s;
+}
+
+int64_t LatencyHistogram::Snapshot::getPercentile(double p) const {
+    if(count == 0) return 0;
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(p * count)));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < counts.size(); ++i){
+        seen += counts[i];
+        if(seen >= rank) return std::min(getBucketEnd(int(i)), max);
+    }
+    return max;
+}
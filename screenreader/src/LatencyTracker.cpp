@@ -0,0 +1,50 @@
+#include "LatencyTracker.h"
+
+#include <stdexcept>
+
+const char *LatencyTracker::getStageName(Stage stage){
+    switch(stage){
+        case CAPTURE: return "capture";
+        case REDUCE : return "reduce";
+        case PUBLISH: return "publish";
+        case HANDOFF: return "handoff";
+        case OUTPUT : return "output";
+        case TOTAL  : return "total";
+        default: throw std::logic_error("No other value is allowed for enum Stage");
+    }
+}
+
+LatencyTracker::LatencyTracker(size_t history):
+    frames(history, Frame{0, LedShm::Timestamps(), false}),
+    lastFeedback(0),
+    anyFeedback(false)
+{
+    if(history == 0) throw std::invalid_argument("History must not be empty");
+}
+
+void LatencyTracker::recordFrame(uint64_t number, const LedShm::Timestamps &t){
+    frames[number % frames.size()] = Frame{number, t, true};
+
+    histograms[CAPTURE].record(int64_t(t.captureEnd - t.captureStart));
+    histograms[REDUCE ].record(int64_t(t.reduceEnd  - t.captureEnd  ));
+    histograms[PUBLISH].record(int64_t(t.published  - t.reduceEnd   ));
+}
+
+void LatencyTracker::recordFeedback(const LedShm::Feedback &feedback){
+    if(anyFeedback && feedback.number == lastFeedback) return;
+    anyFeedback = true;
+    lastFeedback = feedback.number;
+
+    // Frames that were overwritten since, or not captured, are not counted
+    const Frame &frame = frames[feedback.number % frames.size()];
+    if(!frame.valid || frame.number != feedback.number) return;
+
+    const LedShm::Timestamps &t = frame.timestamps;
+    histograms[HANDOFF].record(int64_t(feedback.received - t.published   ));
+    histograms[OUTPUT ].record(int64_t(feedback.output   - feedback.received));
+    histograms[TOTAL  ].record(int64_t(feedback.output   - t.captureStart));
+}
+
+LatencyHistogram::Snapshot LatencyTracker::getSnapshot(Stage stage) const {
+    return histograms[stage].getSnapshot();
+}
@@ -0,0 +1,179 @@
+#include "LedLayout.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+std::string trim(const std::string &s){
+    const size_t b = s.find_first_not_of(" \t\r");
+    if(b == std::string::npos) return "";
+    const size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e-b+1);
+}
+
+int parseCount(const std::string &s){
+    size_t pos = 0;
+    int n = -1;
+    try { n = std::stoi(s, &pos); } catch(const std::exception &e){}
+    if(pos != s.size() || n < 0) throw std::invalid_argument("'" + s + "' is not a non-negative integer");
+    return n;
+}
+}
+
+LedLayout::LedLayout(int NUM_LEDS_X, int NUM_LEDS_Y):
+    start(BOTTOM_RIGHT),
+    direction(CLOCKWISE),
+    cornerGap(0)
+{
+    count[BOTTOM] = NUM_LEDS_X;
+    count[LEFT  ] = NUM_LEDS_Y;
+    count[TOP   ] = NUM_LEDS_X;
+    count[RIGHT ] = NUM_LEDS_Y;
+}
+
+LedLayout LedLayout::fromFile(const std::string &path){
+    std::ifstream is(path);
+    if(!is) throw std::invalid_argument("Could not open layout file " + path);
+
+    LedLayout layout;
+    std::string line;
+    for(int lineNumber = 1; std::getline(is, line); ++lineNumber){
+        line = trim(line);
+        if(line.empty() || line[0] == '#') continue;
+
+        try {
+            const size_t eq = line.find('=');
+            if(eq == std::string::npos) throw std::invalid_argument("expected 'key = value'");
+            const std::string key   = trim(line.substr(0, eq));
+            const std::string value = trim(line.substr(eq+1));
+
+            if(key == "start"){
+                if     (value == "bottom-right") layout.start = BOTTOM_RIGHT;
+                else if(value == "bottom-left" ) layout.start = BOTTOM_LEFT ;
+                else if(value == "top-left"    ) layout.start = TOP_LEFT    ;
+                else if(value == "top-right"   ) layout.start = TOP_RIGHT   ;
+                else throw std::invalid_argument("unknown corner '" + value + "'");
+            } else if(key == "direction"){
+                if     (value == "clockwise"       ) layout.direction = CLOCKWISE;
+                else if(value == "counterclockwise") layout.direction = COUNTERCLOCKWISE;
+                else throw std::invalid_argument("unknown direction '" + value + "'");
+            } else if(key == "bottom"){ layout.count[BOTTOM] = parseCount(value);
+            } else if(key == "left"  ){ layout.count[LEFT  ] = parseCount(value);
+            } else if(key == "top"   ){ layout.count[TOP   ] = parseCount(value);
+            } else if(key == "right" ){ layout.count[RIGHT ] = parseCount(value);
+            } else if(key == "corner_gap"){
+                layout.cornerGap = parseCount(value);
+            } else if(key == "skip"){
+                // Comma-separated indices or ranges, e.g. "14-17, 20"
+                std::stringstream ss(value);
+                std::string item;
+                while(std::getline(ss, item, ',')){
+                    item = trim(item);
+                    if(item.empty()) continue;
+                    const size_t dash = item.find('-');
+                    if(dash == std::string::npos){
+                        layout.skip.insert(parseCount(item));
+                    } else {
+                        const int a = parseCount(trim(item.substr(0, dash)));
+                        const int b = parseCount(trim(item.substr(dash+1)));
+                        for(int i = a; i <= b; ++i) layout.skip.insert(i);
+                    }
+                }
+            } else {
+                throw std::invalid_argument("unknown key '" + key + "'");
+            }
+        } catch(const std::exception &e){
+            std::stringstream ss;
+            ss << path << ":" << lineNumber << ": " << e.what();
+            throw std::invalid_argument(ss.str());
+        }
+    }
+
+    if(layout.getCellsX() == 0 || layout.getCellsY() == 0)
+        throw std::invalid_argument(path + ": layout must have LEDs or gaps on both axes");
+
+    return layout;
+}
+
+int LedLayout::getCount(Edge edge) const { return count[edge]; }
+
+int LedLayout::getNumLeds() const {
+    const int total = count[BOTTOM] + count[LEFT] + count[TOP] + count[RIGHT];
+    int skipped = 0;
+    for(int i: skip) if(i < total) ++skipped;
+    return total - skipped;
+}
+
+int LedLayout::getCellsX() const { return std::max(count[BOTTOM], count[TOP  ]) + 2*cornerGap; }
+int LedLayout::getCellsY() const { return std::max(count[LEFT  ], count[RIGHT]) + 2*cornerGap; }
+
+std::vector<LedLayout::Slot> LedLayout::getSlots(int screenWidth, int screenHeight, int depth) const {
+    const int W = screenWidth;
+    const int H = screenHeight;
+    // Depth of the regions on the sides, and on the top/bottom
+    int depthX = W / getCellsX();
+    int depthY = H / getCellsY();
+    if(depth > 0){
+        depthX = std::min(depthX, depth);
+        depthY = std::min(depthY, depth);
+    }
+
+    // Walk the edges clockwise, starting at the bottom-right corner
+    std::vector<Slot> slots;
+    auto add = [&](Edge edge, int cx, int cy, int bw, int bh){
+        const Rect r(cx - bw/2, cy - bh/2, 2*(bw/2), 2*(bh/2));
+        slots.push_back(Slot{edge, r.intersect(Rect(0, 0, W, H))});
+    };
+
+    const int g = cornerGap;
+    {   // Bottom, right to left
+        const int cells = count[BOTTOM] + 2*g, pitch = cells ? W / cells : 0;
+        for(int k = 0; k < count[BOTTOM]; ++k){
+            const int cell = cells-1 - g - k;
+            add(BOTTOM, pitch*cell + pitch/2, H - depthY/2, pitch, depthY);
+        }
+    }
+    {   // Left, bottom to top
+        const int cells = count[LEFT] + 2*g, pitch = cells ? H / cells : 0;
+        for(int k = 0; k < count[LEFT]; ++k){
+            const int cell = cells-1 - g - k;
+            add(LEFT, depthX/2, pitch*cell + pitch/2, depthX, pitch);
+        }
+    }
+    {   // Top, left to right
+        const int cells = count[TOP] + 2*g, pitch = cells ? W / cells : 0;
+        for(int k = 0; k < count[TOP]; ++k){
+            const int cell = g + k;
+            add(TOP, pitch*cell + pitch/2, depthY/2, pitch, depthY);
+        }
+    }
+    {   // Right, top to bottom
+        const int cells = count[RIGHT] + 2*g, pitch = cells ? H / cells : 0;
+        for(int k = 0; k < count[RIGHT]; ++k){
+            const int cell = g + k;
+            add(RIGHT, W - depthX/2, pitch*cell + pitch/2, depthX, pitch);
+        }
+    }
+
+    // Start at the requested corner
+    int offset = 0;
+    switch(start){
+        case BOTTOM_RIGHT: offset = 0; break;
+        case BOTTOM_LEFT : offset = count[BOTTOM]; break;
+        case TOP_LEFT    : offset = count[BOTTOM] + count[LEFT]; break;
+        case TOP_RIGHT   : offset = count[BOTTOM] + count[LEFT] + count[TOP]; break;
+        default: throw std::logic_error("No other value is allowed for enum Corner");
+    }
+    std::rotate(slots.begin(), slots.begin() + offset, slots.end());
+
+    // Going counterclockwise from a corner is going clockwise into it, backwards
+    if(direction == COUNTERCLOCKWISE) std::reverse(slots.begin(), slots.end());
+
+    std::vector<Slot> ret;
+    for(size_t i = 0; i < slots.size(); ++i){
+        if(!skip.count(i)) ret.push_back(slots[i]);
+    }
+    return ret;
+}
@@ -1,74 +1,201 @@
 #include "LedProcessor.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
+
+namespace {
+// Position of a region along its edge
+double getPosition(const LedLayout::Slot &slot){
+    const Rect &r = slot.rect;
+    if(slot.edge == LedLayout::TOP || slot.edge == LedLayout::BOTTOM) return r.x + r.width /2.0;
+    else                                                              return r.y + r.height/2.0;
+}
+}
 
-std::pair<int, int> LedProcessor::indexToPixel(int i){
-    if(i < 0){
-        throw std::invalid_argument("i must be non-negative");
-    } else if(i < NUM_LEDS_X){ // Bottom
-        int led_x = NUM_LEDS_X - 1 - i;
-
-        int x = PIXELS_PER_LED_X * led_x + PIXELS_PER_LED_X/2;
-        int y = SIZE_Y - PIXELS_PER_LED_Y/2;
-
-        return std::make_pair(x, y);
-    } else if(i < NUM_LEDS_X+NUM_LEDS_Y){ // Left
-        i -= NUM_LEDS_X;
-
-        int led_y = NUM_LEDS_Y - 1 - i;
-
-        int x = PIXELS_PER_LED_X/2;
-        int y = led_y * PIXELS_PER_LED_Y + PIXELS_PER_LED_Y/2;
-
-        return std::make_pair(x, y);
-    } else if(i < 2*NUM_LEDS_X+NUM_LEDS_Y){ // Top
-        i -= NUM_LEDS_X+NUM_LEDS_Y;
-
-        int led_x = i;
+LedProcessor::Interpolation LedProcessor::parseInterpolation(const std::string &s){
+    if(s == "linear") return LINEAR;
+    if(s == "spline") return CATMULL_ROM;
+    throw std::invalid_argument("Unknown interpolation '" + s + "'");
+}
 
-        int x = PIXELS_PER_LED_X * led_x + PIXELS_PER_LED_X/2;
-        int y = PIXELS_PER_LED_Y/2;
+std::vector<LedLayout::Slot> LedProcessor::getSampleSlots(const std::vector<LedLayout::Slot> &leds, const Sampling &sampling){
+    if(!sampling.enabled()) return leds;
+
+    std::vector<LedLayout::Slot> samples;
+    for(int e = 0; e < LedLayout::NUM_EDGES; ++e){
+        const LedLayout::Edge edge = LedLayout::Edge(e);
+        const bool horizontal = (edge == LedLayout::TOP || edge == LedLayout::BOTTOM);
+
+        // Span of the LEDs along the edge; every LED of an edge has the
+        // same extent across it
+        int begin = 0, end = 0, count = 0;
+        Rect across;
+        for(const LedLayout::Slot &led: leds){
+            if(led.edge != edge) continue;
+            const int b = (horizontal ? led.rect.x : led.rect.y);
+            const int l = (horizontal ? led.rect.width : led.rect.height);
+            if(count == 0){ begin = b; end = b + l; across = led.rect; }
+            begin = std::min(begin, b);
+            end = std::max(end, b + l);
+            ++count;
+        }
+
+        // More samples than LEDs would only add work
+        const int n = std::min(count, horizontal ? sampling.countX : sampling.countY);
+        if(n == 0) continue;
+        const int pitch = (end - begin) / n;
+        for(int k = 0; k < n; ++k){
+            // Even widths, as LedLayout gives its cells
+            const int b = begin + pitch*k;
+            const Rect r = (horizontal ?
+                Rect(b, across.y, 2*(pitch/2), across.height) :
+                Rect(across.x, b, across.width, 2*(pitch/2)));
+            samples.push_back(LedLayout::Slot{edge, r});
+        }
+    }
+    return samples;
+}
 
-        return std::make_pair(x, y);
-    } else if(i < 2*NUM_LEDS_X+2*NUM_LEDS_Y){ // Right
-        i -= 2*NUM_LEDS_X+NUM_LEDS_Y;
+LedProcessor::LedProcessor(ScreenProcessor &processor_, const LedLayout &layout, int depth, const Sampling &sampling):
+    processor(processor_),
+    pool(nullptr),
+    reduceTask(*this),
+    first(true),
+    numLeds(0)
+{
+    const int W = processor.getWidth(), H = processor.getHeight();
+    const std::vector<LedLayout::Slot> leds = layout.getSlots(W, H, depth);
+    const std::vector<LedLayout::Slot> samples = getSampleSlots(leds, sampling);
 
-        int led_y = i;
+    for(const LedLayout::Slot &slot: samples){
+        processor.validate(slot.rect);
+        regions.push_back(slot.rect);
+    }
+    colors.assign(regions.size(), Color<uint8_t>(0, 0, 0, 0xFF));
 
-        int x = SIZE_X - PIXELS_PER_LED_X/2;
-        int y = led_y * PIXELS_PER_LED_Y + PIXELS_PER_LED_Y/2;
+    numLeds = leds.size();
+    if(sampling.enabled()) buildWeights(leds, samples, sampling.interpolation);
+}
 
-        return std::make_pair(x, y);
-    } else {
-        throw std::invalid_argument("i must be smaller than 2*NUM_LEDS_X+2*NUM_LEDS_Y");
+void LedProcessor::buildWeights(const std::vector<LedLayout::Slot> &leds, const std::vector<LedLayout::Slot> &samples, Interpolation interpolation){
+    // Samples of each edge, by position
+    std::vector<std::pair<double, uint32_t>> edges[LedLayout::NUM_EDGES];
+    for(size_t i = 0; i < samples.size(); ++i)
+        edges[samples[i].edge].push_back(std::make_pair(getPosition(samples[i]), uint32_t(i)));
+    for(auto &edge: edges) std::sort(edge.begin(), edge.end());
+
+    const int32_t ONE = 1 << WEIGHT_BITS;
+    for(const LedLayout::Slot &led: leds){
+        const std::vector<std::pair<double, uint32_t>> &edge = edges[led.edge];
+        if(edge.empty()) throw std::invalid_argument("Sampling needs samples on every edge that has LEDs");
+        const int n = edge.size();
+        const double x = getPosition(led);
+
+        // Samples k and k+1 surround the LED, at fraction t between them;
+        // beyond the outermost samples, LEDs take their colour
+        int k = 0;
+        double t = 0;
+        if(n > 1 && x > edge.front().first){
+            k = std::upper_bound(edge.begin(), edge.end(), x,
+                [](double v, const std::pair<double, uint32_t> &e){ return v < e.first; }) - edge.begin() - 1;
+            if(k >= n-1){ k = n-2; t = 1; }
+            else t = (x - edge[k].first) / (edge[k+1].first - edge[k].first);
+        }
+
+        double w[4] = {0, 0, 0, 0};
+        if(interpolation == LINEAR){
+            w[1] = 1 - t;
+            w[2] = t;
+        } else {
+            const double t2 = t*t, t3 = t2*t;
+            w[0] = (-t3 + 2*t2 - t) / 2;
+            w[1] = (3*t3 - 5*t2 + 2) / 2;
+            w[2] = (-3*t3 + 4*t2 + t) / 2;
+            w[3] = (t3 - t2) / 2;
+        }
+
+        // Samples past the ends repeat the outermost ones; merge their
+        // weights, and make them add up to exactly ONE so that a uniform
+        // colour comes out unchanged
+        const size_t row = weights.size();
+        rowStart.push_back(row);
+        int32_t total = 0;
+        for(int j = 0; j < 4; ++j){
+            const int32_t weight = int32_t(std::lround(w[j] * ONE));
+            if(weight == 0) continue;
+            const uint32_t sample = edge[std::min(std::max(k-1+j, 0), n-1)].second;
+            total += weight;
+
+            bool merged = false;
+            for(size_t i = row; i < weights.size() && !merged; ++i){
+                if(weights[i].sample == sample){ weights[i].weight += weight; merged = true; }
+            }
+            if(!merged) weights.push_back(Weight{sample, weight});
+        }
+        auto largest = std::max_element(weights.begin() + row, weights.end(),
+            [](const Weight &a, const Weight &b){ return a.weight < b.weight; });
+        largest->weight += ONE - total;
     }
+    rowStart.push_back(weights.size());
 }
 
-LedProcessor::LedProcessor(ScreenProcessor &processor_, const int NUM_LEDS_X_, const int NUM_LEDS_Y_):
-    processor(processor_),
-    NUM_LEDS_X(NUM_LEDS_X_), NUM_LEDS_Y(NUM_LEDS_Y_),
-    SIZE_X(processor.getWidth ()),
-    SIZE_Y(processor.getHeight()),
-    PIXELS_PER_LED_X(processor.getWidth () / NUM_LEDS_X),
-    PIXELS_PER_LED_Y(processor.getHeight() / NUM_LEDS_Y)
-{
+size_t LedProcessor::getNumLeds() const {
+    return numLeds;
+}
+
+void LedProcessor::setPool(WorkerPool *pool_){
+    pool = pool_;
 }
 
 void LedProcessor::update(){
     processor.update();
 }
 
-size_t LedProcessor::copy(uint8_t *dest){
-    const size_t NUM_LEDS_TOTAL = 2*NUM_LEDS_X + 2*NUM_LEDS_Y;
-    for(size_t i = 0; i < NUM_LEDS_TOTAL; ++i){
-        const std::pair<int,int> pos = indexToPixel(i);
-        const int &x = pos.first;
-        const int &y = pos.second;
-        const Color<uint8_t> &c = processor.getColor(x, y);
-        *(dest++) = c.r;
-        *(dest++) = c.g;
-        *(dest++) = c.b;
+void LedProcessor::reduce(size_t begin, size_t end){
+    for(size_t i = begin; i < end; ++i){
+        if(first || processor.isChanged(regions[i]))
+            colors[i] = processor.getColor(regions[i]);
     }
-    return NUM_LEDS_TOTAL*3;
 }
+
+size_t LedProcessor::copy(LedFrame &dest, size_t offset){
+    if(pool) pool->run(reduceTask, regions.size());
+    else     reduce(0, regions.size());
+    first = false;
+
+    uint8_t *r = dest.channel(LedFrame::R) + offset;
+    uint8_t *g = dest.channel(LedFrame::G) + offset;
+    uint8_t *b = dest.channel(LedFrame::B) + offset;
+
+    if(rowStart.empty()){
+        for(size_t i = 0; i < regions.size(); ++i){
+            const Color<uint8_t> &c = colors[i];
+            r[i] = c.r;
+            g[i] = c.g;
+            b[i] = c.b;
+        }
+        return regions.size();
+    }
+
+    // Splines can overshoot, so results are clamped
+    auto toByte = [](int32_t v){
+        v = (v + (1 << (WEIGHT_BITS-1))) >> WEIGHT_BITS;
+        return uint8_t(v < 0 ? 0 : v > 255 ? 255 : v);
+    };
+    for(size_t i = 0; i < numLeds; ++i){
+        int32_t sr = 0, sg = 0, sb = 0;
+        for(uint32_t j = rowStart[i]; j < rowStart[i+1]; ++j){
+            const Color<uint8_t> &c = colors[weights[j].sample];
+            const int32_t w = weights[j].weight;
+            sr += w * c.r;
+            sg += w * c.g;
+            sb += w * c.b;
+        }
+        r[i] = toByte(sr);
+        g[i] = toByte(sg);
+        b[i] = toByte(sb);
+    }
+    return numLeds;
+}
\ No newline at end of file
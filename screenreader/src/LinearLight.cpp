@@ -0,0 +1,30 @@
+#include "LinearLight.h"
+
+#include <cmath>
+
+namespace {
+double srgbToLinear(double c){
+    return (c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+}
+
+double linearToSrgb(double l){
+    return (l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0/2.4) - 0.055);
+}
+
+struct Tables {
+    uint16_t decode[256];
+    uint8_t encode[LinearLight::MAX + 1];
+
+    Tables(){
+        for(int b = 0; b < 256; ++b)
+            decode[b] = uint16_t(std::lround(srgbToLinear(b / 255.0) * LinearLight::MAX));
+        for(uint32_t v = 0; v <= LinearLight::MAX; ++v)
+            encode[v] = uint8_t(std::lround(linearToSrgb(double(v) / LinearLight::MAX) * 255));
+    }
+};
+
+const Tables tables;
+}
+
+const uint16_t *const LinearLight::DECODE = tables.decode;
+const uint8_t  *const LinearLight::ENCODE = tables.encode;
@@ -0,0 +1,102 @@
+#include "PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+struct CounterInfo {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const CounterInfo COUNTERS[PerfCounters::NUM_COUNTERS] = {
+    {"cycles"       , PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES   },
+    {"instructions" , PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    {"cache_misses" , PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK   }
+};
+
+int perfEventOpen(perf_event_attr *attr, pid_t pid, int cpu, int groupFd, unsigned long flags){
+    return syscall(__NR_perf_event_open, attr, pid, cpu, groupFd, flags);
+}
+}
+
+PerfCounters::PerfCounters():
+    leader(-1),
+    numOpen(0)
+{
+    for(int i = 0; i < NUM_COUNTERS; ++i) fds[i] = -1;
+
+    for(int i = 0; i < NUM_COUNTERS; ++i){
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = COUNTERS[i].type;
+        attr.config = COUNTERS[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // The group starts when complete
+        attr.disabled = (leader == -1);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        const int fd = perfEventOpen(&attr, 0, -1, leader, 0);
+        if(fd == -1){
+            if(!error.empty()) error += ", ";
+            error += std::string(COUNTERS[i].name) + ": " + strerror(errno);
+            continue;
+        }
+        fds[i] = fd;
+        if(leader == -1) leader = fd;
+        order[numOpen++] = Counter(i);
+    }
+
+    if(leader != -1){
+        ioctl(leader, PERF_EVENT_IOC_RESET , PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+bool PerfCounters::isAvailable(Counter counter) const {
+    return fds[counter] != -1;
+}
+
+bool PerfCounters::isAvailable() const {
+    return leader != -1;
+}
+
+const std::string &PerfCounters::getError() const {
+    return error;
+}
+
+void PerfCounters::read(uint64_t values[NUM_COUNTERS]) const {
+    for(int i = 0; i < NUM_COUNTERS; ++i) values[i] = 0;
+    if(leader == -1) return;
+
+    // nr, time enabled, time running, then one value per counter
+    uint64_t buffer[3 + NUM_COUNTERS];
+    const ssize_t size = ::read(leader, buffer, sizeof(buffer));
+    if(size < ssize_t(3*sizeof(uint64_t)) || buffer[0] != uint64_t(numOpen)) return;
+
+    const uint64_t enabled = buffer[1], running = buffer[2];
+    for(int i = 0; i < numOpen; ++i){
+        uint64_t value = buffer[3+i];
+        if(running > 0 && running < enabled) value = uint64_t(double(value) * enabled / running);
+        values[order[i]] = value;
+    }
+}
+
+const char *PerfCounters::getName(Counter counter){
+    return COUNTERS[counter].name;
+}
+
+PerfCounters::~PerfCounters(){
+    for(int i = 0; i < NUM_COUNTERS; ++i){
+        if(fds[i] != -1) close(fds[i]);
+    }
+}
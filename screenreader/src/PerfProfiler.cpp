@@ -0,0 +1,134 @@
+#include "PerfProfiler.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+// Strings written to the file come from strerror, but quote them properly
+// anyway
+std::string jsonEscape(const std::string &s){
+    std::string ret;
+    for(char c: s){
+        if(c == '"' || c == '\\') ret += '\\';
+        if(c >= 0 && c < 0x20) continue;
+        ret += c;
+    }
+    return ret;
+}
+}
+
+const char *PerfProfiler::getStageName(Stage stage){
+    switch(stage){
+        case CAPTURE: return "capture";
+        case REDUCE : return "reduce";
+        case PUBLISH: return "publish";
+        default: throw std::logic_error("No other value is allowed for enum Stage");
+    }
+}
+
+PerfProfiler::PerfProfiler(const std::string &path_):
+    path(path_),
+    file(nullptr),
+    opened(false),
+    frames(0)
+{
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+        available[c] = false;
+        last[c] = 0;
+        for(int s = 0; s < NUM_STAGES; ++s){
+            frame[s][c] = 0;
+            totals[s][c] = 0;
+        }
+    }
+
+    file = fopen(path.c_str(), "w");
+    if(file == NULL){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not create " + path
+        );
+    }
+}
+
+void PerfProfiler::open(){
+    counters.reset(new PerfCounters());
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c)
+        available[c] = counters->isAvailable(PerfCounters::Counter(c));
+    opened.store(true, std::memory_order_release);
+
+    if(!counters->isAvailable()){
+        fprintf(stderr, "[PERF] No performance counters available (%s); only frames are counted\n", counters->getError().c_str());
+    } else if(!counters->getError().empty()){
+        fprintf(stderr, "[PERF] Some performance counters are unavailable: %s\n", counters->getError().c_str());
+    }
+
+    fprintf(file, "{\"type\":\"counters\",\"available\":{");
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+        fprintf(file, "%s\"%s\":%s", c ? "," : "", PerfCounters::getName(PerfCounters::Counter(c)), available[c] ? "true" : "false");
+    }
+    fprintf(file, "},\"error\":\"%s\"}\n", jsonEscape(counters->getError()).c_str());
+}
+
+void PerfProfiler::beginFrame(){
+    if(!counters) open();
+    counters->read(last);
+}
+
+void PerfProfiler::endStage(Stage stage){
+    uint64_t now[PerfCounters::NUM_COUNTERS];
+    counters->read(now);
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+        frame[stage][c] = now[c] - last[c];
+        last[c] = now[c];
+    }
+}
+
+void PerfProfiler::writeStages(const uint64_t counts[NUM_STAGES][PerfCounters::NUM_COUNTERS]){
+    for(int s = 0; s < NUM_STAGES; ++s){
+        fprintf(file, ",\"%s\":{", getStageName(Stage(s)));
+        for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+            const char *name = PerfCounters::getName(PerfCounters::Counter(c));
+            if(available[c]) fprintf(file, "%s\"%s\":%llu", c ? "," : "", name, (unsigned long long)counts[s][c]);
+            else             fprintf(file, "%s\"%s\":null", c ? "," : "", name);
+        }
+        fprintf(file, "}");
+    }
+}
+
+void PerfProfiler::endFrame(uint64_t number){
+    fprintf(file, "{\"type\":\"frame\",\"number\":%llu", (unsigned long long)number);
+    writeStages(frame);
+    fprintf(file, "}\n");
+
+    for(int s = 0; s < NUM_STAGES; ++s){
+        for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+            totals[s][c].store(totals[s][c].load(std::memory_order_relaxed) + frame[s][c], std::memory_order_relaxed);
+            frame[s][c] = 0;
+        }
+    }
+    frames.store(frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+PerfProfiler::Totals PerfProfiler::getTotals() const {
+    Totals t;
+    const bool isOpen = opened.load(std::memory_order_acquire);
+    t.frames = frames.load(std::memory_order_relaxed);
+    for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+        t.available[c] = isOpen && available[c];
+        for(int s = 0; s < NUM_STAGES; ++s) t.counts[s][c] = totals[s][c].load(std::memory_order_relaxed);
+    }
+    return t;
+}
+
+void PerfProfiler::writeTotals(){
+    const Totals t = getTotals();
+    fprintf(file, "{\"type\":\"total\",\"frames\":%llu", (unsigned long long)t.frames);
+    writeStages(t.counts);
+    fprintf(file, "}\n");
+    fflush(file);
+}
+
+PerfProfiler::~PerfProfiler(){
+    fclose(file);
+}
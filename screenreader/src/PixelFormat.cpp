@@ -0,0 +1,49 @@
+#include "PixelFormat.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+struct FormatInfo {
+    const char *name;
+    int bitsPerPixel;
+    uint32_t redMask, greenMask, blueMask;
+};
+
+const FormatInfo FORMATS[NUM_PIXEL_FORMATS] = {
+    {"argb8888", 32, 0x00ff0000, 0x0000ff00, 0x000000ff},
+    {"abgr8888", 32, 0x000000ff, 0x0000ff00, 0x00ff0000},
+    {"rgb565"  , 16, 0xf800    , 0x07e0    , 0x001f    },
+    {"bgr565"  , 16, 0x001f    , 0x07e0    , 0xf800    }
+};
+}
+
+int PixelFormats::getBytesPerPixel(PixelFormat format){
+    return FORMATS[format].bitsPerPixel / 8;
+}
+
+const char *PixelFormats::getName(PixelFormat format){
+    return FORMATS[format].name;
+}
+
+PixelFormat PixelFormats::parse(const std::string &name){
+    for(int i = 0; i < NUM_PIXEL_FORMATS; ++i){
+        if(name == FORMATS[i].name) return PixelFormat(i);
+    }
+    throw std::invalid_argument("Unknown pixel format '" + name + "'");
+}
+
+PixelFormat PixelFormats::fromMasks(int bitsPerPixel, uint32_t redMask, uint32_t greenMask, uint32_t blueMask){
+    for(int i = 0; i < NUM_PIXEL_FORMATS; ++i){
+        const FormatInfo &f = FORMATS[i];
+        if(
+            f.bitsPerPixel == bitsPerPixel &&
+            f.redMask == redMask && f.greenMask == greenMask && f.blueMask == blueMask
+        ) return PixelFormat(i);
+    }
+
+    std::stringstream ss;
+    ss  << "Unsupported pixel format: " << bitsPerPixel << " bits per pixel, "
+        << std::hex << "masks 0x" << redMask << ", 0x" << greenMask << ", 0x" << blueMask;
+    throw std::invalid_argument(ss.str());
+}
@@ -0,0 +1,87 @@
+#include "RateGovernor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+RateGovernor::RateGovernor(size_t numLeds_, const Options &options_):
+    options(options_),
+    numLeds(numLeds_),
+    previous(numLeds_),
+    first(true),
+    state(NORMAL),
+    quietFrames(0),
+    stats()
+{
+    if(!(
+        0 < options.fastPeriodNanos &&
+        options.fastPeriodNanos <= options.normalPeriodNanos &&
+        options.normalPeriodNanos <= options.idlePeriodNanos
+    )) throw std::invalid_argument("Periods must be positive, and fast <= normal <= idle");
+    if(options.stillThreshold > options.motionThreshold)
+        throw std::invalid_argument("The still threshold must not exceed the motion threshold");
+}
+
+int64_t RateGovernor::getPeriod() const {
+    switch(state){
+        case FAST  : return options.fastPeriodNanos;
+        case NORMAL: return options.normalPeriodNanos;
+        case IDLE  : return options.idlePeriodNanos;
+        default: throw std::logic_error("No other value is allowed for enum State");
+    }
+}
+
+int64_t RateGovernor::update(const LedFrame &frame){
+    // One channel at a time, so the loop vectorizes across LEDs
+    uint64_t diff = 0;
+    uint8_t brightest = 0;
+    for(int c = 0; c < LedFrame::NUM_CHANNELS; ++c){
+        const uint8_t *cur  = frame   .channel(LedFrame::Channel(c));
+        uint8_t       *prev = previous.channel(LedFrame::Channel(c));
+        uint32_t channelDiff = 0;
+        for(size_t i = 0; i < numLeds; ++i){
+            channelDiff += std::abs(int(cur[i]) - int(prev[i]));
+            brightest = std::max(brightest, cur[i]);
+        }
+        std::copy(cur, cur + numLeds, prev);
+        diff += channelDiff;
+    }
+
+    // Frames closer together change less between them, so scale the change
+    // up to what it would be over a normal period
+    const int64_t period = getPeriod();
+    double change = (numLeds ? double(diff) / (numLeds*3) : 0.0);
+    if(period < options.normalPeriodNanos) change *= double(options.normalPeriodNanos) / period;
+    if(first){
+        change = 0.0;
+        first = false;
+    }
+
+    const bool black = (brightest <= options.blackLevel);
+    if(change >= options.motionThreshold && !black){
+        state = FAST;
+        quietFrames = 0;
+    } else if(change < options.stillThreshold || black){
+        quietFrames = std::min(quietFrames+1, options.idleFrames);
+        state = (quietFrames >= options.idleFrames ? IDLE : NORMAL);
+    } else {
+        state = NORMAL;
+        quietFrames = 0;
+    }
+
+    ++stats.frames[state];
+    return getPeriod();
+}
+
+int64_t RateGovernor::updateBlanked(){
+    state = IDLE;
+    quietFrames = options.idleFrames;
+    // Do not compare the first frame after unblanking with the last before
+    first = true;
+    ++stats.frames[state];
+    return getPeriod();
+}
+
+RateGovernor::State RateGovernor::getState() const { return state; }
+
+RateGovernor::Stats RateGovernor::getStats() const { return stats; }
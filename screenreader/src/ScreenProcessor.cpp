@@ -1,47 +1,232 @@
 #include "ScreenProcessor.h"
 
+#include "Kernels.h"
+
+#include <stdexcept>
+
 ScreenProcessor::ScreenProcessor(
     ScreenReader &reader_,
     int colorWidth_,
-    int colorHeight_
+    int colorHeight_,
+    Mode mode_,
+    bool linear_
 ):
     reader(reader_),
+    pool(nullptr),
+    tableTask(*this),
     colorWidth (colorWidth_ ),
     colorHeight(colorHeight_),
     screenWidth (reader.getScreenWidth ()),
-    screenHeight(reader.getScreenHeight())
-{}
+    screenHeight(reader.getScreenHeight()),
+    mode(mode_),
+    linear(linear_)
+{
+    if(linear) selectFunctions<true >();
+    else       selectFunctions<false>();
+
+    if(mode == SUMMED_AREA_TABLE){
+        for(int i = 0; i < ScreenReader::NUM_STRIPS; ++i){
+            SummedAreaTable &table = tables[i];
+            const StripSpan &span = reader.getStrip(ScreenReader::Strip(i));
+            table.width  = span.width;
+            table.height = span.height;
+            table.sums.assign(size_t(table.width+1)*(table.height+1)*3, 0);
+        }
+    }
+}
+
+template<bool LINEAR>
+void ScreenProcessor::selectFunctions(){
+    switch(reader.getPixelFormat()){
+        case ARGB8888:
+            buildTableFunction     = &ScreenProcessor::buildTable    <ARGB8888, LINEAR>;
+            getColorDirectFunction = &ScreenProcessor::getColorDirect<ARGB8888, LINEAR>;
+            break;
+        case ABGR8888:
+            buildTableFunction     = &ScreenProcessor::buildTable    <ABGR8888, LINEAR>;
+            getColorDirectFunction = &ScreenProcessor::getColorDirect<ABGR8888, LINEAR>;
+            break;
+        case RGB565:
+            buildTableFunction     = &ScreenProcessor::buildTable    <RGB565, LINEAR>;
+            getColorDirectFunction = &ScreenProcessor::getColorDirect<RGB565, LINEAR>;
+            break;
+        case BGR565:
+            buildTableFunction     = &ScreenProcessor::buildTable    <BGR565, LINEAR>;
+            getColorDirectFunction = &ScreenProcessor::getColorDirect<BGR565, LINEAR>;
+            break;
+        default: throw std::logic_error("No other value is allowed for enum PixelFormat");
+    }
+}
+
+ScreenProcessor::Mode ScreenProcessor::parseMode(const std::string &s){
+    if(s == "direct") return DIRECT;
+    if(s == "sat"   ) return SUMMED_AREA_TABLE;
+    throw std::invalid_argument("Unknown reduction mode '" + s + "'");
+}
+
+void ScreenProcessor::setPool(WorkerPool *pool_){
+    pool = pool_;
+}
 
 int ScreenProcessor::getWidth (){ return reader.getScreenWidth (); }
 int ScreenProcessor::getHeight(){ return reader.getScreenHeight(); }
 
-Color<uint8_t> ScreenProcessor::getColor(const int x, const int y){
-    int r = 0, g = 0, b = 0, a = 0;
-    size_t n = 0;
-    for(int deltaX = -colorWidth/2; deltaX < colorWidth/2; ++deltaX){
-        for(int deltaY = -colorHeight/2; deltaY < colorHeight/2; ++deltaY){
-            const int xPixel = x + deltaX;
-            const int yPixel = y + deltaY;
-            if(
-                0 <= xPixel && xPixel < screenWidth  &&
-                0 <= yPixel && yPixel < screenHeight
-            ) {
-                Color<uint8_t> c = reader.getPixel(xPixel, yPixel);
-                r += c.r;
-                g += c.g;
-                b += c.b;
-                a += c.a;
-                n++;
+template<PixelFormat F, bool LINEAR>
+void ScreenProcessor::buildTable(ScreenReader::Strip strip){
+    typedef PixelTraits<F> T;
+    const uint16_t *decode = LinearLight::DECODE;
+    SummedAreaTable &table = tables[strip];
+    const StripSpan &span = reader.getStrip(strip);
+    const int W = span.width;
+    const int H = span.height;
+    const size_t rowSize = size_t(W+1)*3;
+
+    // Row 0 and column 0 are always zero
+    uint32_t *prev = table.sums.data();
+    for(int y = 0; y < H; ++y){
+        uint32_t *cur = prev + rowSize;
+        const typename T::Pixel *data = span.row<F>(y);
+        uint32_t r = 0, g = 0, b = 0;
+        for(int x = 0; x < W; ++x){
+            const typename T::Pixel p = data[x];
+            if(LINEAR){
+                r += decode[T::red  (p)];
+                g += decode[T::green(p)];
+                b += decode[T::blue (p)];
+            } else {
+                r += T::red  (p);
+                g += T::green(p);
+                b += T::blue (p);
             }
+            cur[3*(x+1)+0] = prev[3*(x+1)+0] + r;
+            cur[3*(x+1)+1] = prev[3*(x+1)+1] + g;
+            cur[3*(x+1)+2] = prev[3*(x+1)+2] + b;
+        }
+        prev = cur;
+    }
+}
+
+template<PixelFormat F, bool LINEAR>
+Color<uint8_t> ScreenProcessor::getColorDirect(const Rect &region){
+    // The region may span more than one strip (e.g. near the corners),
+    // so add up its intersection with each of them, a row at a time
+    uint32_t sums[3] = {0, 0, 0};
+    size_t n = 0;
+    for(int i = 0; i < ScreenReader::NUM_STRIPS; ++i){
+        const StripSpan &span = reader.getStrip(ScreenReader::Strip(i));
+        const Rect in = span.clip(region);
+        if(in.empty()) continue;
+
+        for(int y = in.y; y < in.bottom(); ++y){
+            if(LINEAR) Kernels::sumRowLinearOf<F>(span.row<F>(y) + in.x, in.width, sums);
+            else       Kernels::sumRowOf      <F>(span.row<F>(y) + in.x, in.width, sums);
         }
+        n += size_t(in.width)*in.height;
+    }
+    if(n == 0) return Color<uint8_t>(0, 0, 0, 0xFF);
+
+    if(LINEAR){
+        return Color<uint8_t>(
+            LinearLight::encodeAverage(sums[0], n),
+            LinearLight::encodeAverage(sums[1], n),
+            LinearLight::encodeAverage(sums[2], n),
+            0xFF
+        );
+    }
+    return Color<uint8_t>(sums[0]/n, sums[1]/n, sums[2]/n, 0xFF);
+}
+
+Color<uint8_t> ScreenProcessor::getColorSummedAreaTable(const Rect &region){
+    // The region may span more than one strip (e.g. near the corners),
+    // so add up its intersection with each of them
+    uint32_t r = 0, g = 0, b = 0;
+    size_t n = 0;
+    for(int k = 0; k < ScreenReader::NUM_STRIPS; ++k){
+        const SummedAreaTable &table = tables[k];
+        const Rect i = reader.getStrip(ScreenReader::Strip(k)).clip(region);
+        if(i.empty()) continue;
+        const int ix0 = i.x, ix1 = i.right ();
+        const int iy0 = i.y, iy1 = i.bottom();
+
+        const size_t rowSize = size_t(table.width+1)*3;
+        const uint32_t *A = &table.sums[iy0*rowSize + ix0*3];
+        const uint32_t *B = &table.sums[iy0*rowSize + ix1*3];
+        const uint32_t *C = &table.sums[iy1*rowSize + ix0*3];
+        const uint32_t *D = &table.sums[iy1*rowSize + ix1*3];
+        r += D[0] - B[0] - C[0] + A[0];
+        g += D[1] - B[1] - C[1] + A[1];
+        b += D[2] - B[2] - C[2] + A[2];
+        n += size_t(i.width)*i.height;
+    }
+    if(n == 0) return Color<uint8_t>(0, 0, 0, 0xFF);
+
+    if(linear){
+        return Color<uint8_t>(
+            LinearLight::encodeAverage(r, n),
+            LinearLight::encodeAverage(g, n),
+            LinearLight::encodeAverage(b, n),
+            0xFF
+        );
+    }
+    return Color<uint8_t>(r/n, g/n, b/n, 0xFF);
+}
+
+void ScreenProcessor::validate(const Rect &region){
+    if(
+        region.x < 0 || region.right () > screenWidth  ||
+        region.y < 0 || region.bottom() > screenHeight ||
+        region.empty()
+    ) throw std::invalid_argument("Region must be non-empty and within the screen");
+
+    // Strips do not overlap, so the region is covered iff the areas of its
+    // intersections with the strips add up to its own area
+    size_t covered = 0, sampled = 0;
+    for(int i = 0; i < ScreenReader::NUM_STRIPS; ++i){
+        const StripSpan &span = reader.getStrip(ScreenReader::Strip(i));
+        const Rect in = region.intersect(span.getRect());
+        if(!in.empty()) covered += size_t(in.width)*in.height;
+        const Rect lines = span.clip(region);
+        if(!lines.empty()) sampled += size_t(lines.width)*lines.height;
+    }
+    if(covered != size_t(region.width)*region.height)
+        throw std::invalid_argument("Region is not entirely covered by the captured strips");
+    if(sampled == 0)
+        throw std::invalid_argument("Region contains none of the captured lines");
+}
+
+Color<uint8_t> ScreenProcessor::getColor(const int x, const int y){
+    const Rect box(x - colorWidth/2, y - colorHeight/2, 2*(colorWidth/2), 2*(colorHeight/2));
+    return getColor(box.intersect(Rect(0, 0, screenWidth, screenHeight)));
+}
+
+Color<uint8_t> ScreenProcessor::getColor(const Rect &region){
+    switch(mode){
+        case DIRECT           : return (this->*getColorDirectFunction)(region);
+        case SUMMED_AREA_TABLE: return getColorSummedAreaTable(region);
+        default: throw std::logic_error("No other value is allowed for enum Mode");
+    }
+}
+
+bool ScreenProcessor::isChanged(const Rect &region) const {
+    return reader.isChanged(region);
+}
+
+void ScreenProcessor::TableTask::execute(size_t begin, size_t end){
+    // The table of a strip that did not change is still up to date
+    for(size_t i = begin; i < end; ++i){
+        if(processor.reader.isChanged(ScreenReader::Strip(i)))
+            (processor.*processor.buildTableFunction)(ScreenReader::Strip(i));
     }
-    r /= n;
-    g /= n;
-    b /= n;
-    a /= n;
-    return Color<uint8_t>(r, g, b, a);
 }
 
 void ScreenProcessor::update(){
     reader.update();
+    updateTables();
+}
+
+void ScreenProcessor::updateTables(){
+    if(mode == SUMMED_AREA_TABLE){
+        if(pool) pool->run(tableTask, ScreenReader::NUM_STRIPS, 1);
+        else     tableTask.execute(0, ScreenReader::NUM_STRIPS);
+    }
 }
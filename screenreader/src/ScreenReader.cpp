@@ -1,122 +1,198 @@
 #include "ScreenReader.h"
 
+#include <algorithm>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 
 #include <iostream>
 
-void ScreenReader::initDisplay(){
-    dsp = XOpenDisplay(NULL);
-    if (!dsp){
-        throw std::system_error(
-            std::error_code(errno, std::system_category()),
-            "Could not open a connection to the X server"
-        );
+namespace {
+/**
+ * @brief Fingerprint of a run of pixels, ignoring alpha and padding.
+ *
+ * The low half is the sum of the pixels, the high half their sum weighted
+ * by odd position-dependent factors, both modulo 2^32. A change to any
+ * single pixel always changes the weighted sum, and the loop vectorizes.
+ */
+template<PixelFormat F>
+uint64_t hashPixels(const typename PixelTraits<F>::Pixel *p, int n){
+    uint32_t sum = 0, weighted = 0;
+    for(int i = 0; i < n; ++i){
+        const uint32_t v = p[i] & PixelTraits<F>::COLOR_MASK;
+        sum      += v;
+        weighted += v * uint32_t(2*i+1);
     }
+    return (uint64_t(weighted) << 32) | sum;
+}
+}
 
-    if (!XShmQueryExtension(dsp)){
-        std::error_code ec(errno, std::system_category());
-        XCloseDisplay(dsp);
-        throw std::system_error(
-            ec,
-            "The X server does not support the XSHM extension\n"
-        );
+void ScreenReader::initRegions(){
+    const Rect rects[NUM_STRIPS] = {
+        Rect(0, screenHeight-MARGIN_Y, screenWidth, MARGIN_Y),                  // Bottom
+        Rect(0, MARGIN_Y, MARGIN_X, screenHeight - 2*MARGIN_Y),                 // Left
+        Rect(0, 0, screenWidth, MARGIN_Y),                                      // Top
+        Rect(screenWidth-MARGIN_X, MARGIN_Y, MARGIN_X, screenHeight - 2*MARGIN_Y) // Right
+    };
+
+    for(int i = 0; i < NUM_STRIPS; ++i){
+        const Rect &rect = rects[i];
+        StripSpan &span = spans[i];
+        span.rect = rect;
+        span.step = step;
+        span.format = format;
+
+        if(step == 1){
+            // Whole strip in one piece
+            handles[i] = source.addRegion(rect);
+            span.width  = rect.width;
+            span.height = rect.height;
+        } else {
+            // One line every step pixels across the depth of the strip:
+            // rows for the top and bottom strips, columns for the sides
+            span.transposed = (i == LEFT || i == RIGHT);
+            std::vector<Rect> lines;
+            if(span.transposed){
+                for(int x = rect.x; x < rect.right(); x += step)
+                    lines.push_back(Rect(x, rect.y, 1, rect.height));
+                span.width = rect.height;
+            } else {
+                for(int y = rect.y; y < rect.bottom(); y += step)
+                    lines.push_back(Rect(rect.x, y, rect.width, 1));
+                span.width = rect.width;
+            }
+            span.height = lines.size();
+            handles[i] = source.addRegion(lines);
+        }
+        span.stride = span.width;
+        span.data   = source.getRegion(handles[i]);
     }
 }
 
-unsigned int *ScreenReader::createShm(int width, int height, XShmSegmentInfo &info){
-    // Create a shared memory area
-    info.shmid = shmget(IPC_PRIVATE, width * height * BITS_PER_PIXEL, IPC_CREAT | 0600);
-    if (info.shmid == -1){
-        throw std::system_error(
-            std::error_code(errno, std::system_category()),
-            "Reading screen"
-        );
+ScreenReader::ScreenReader(FrameSource &source_, int NUM_LEDS_X, int NUM_LEDS_Y, int depth, int step_):
+    source(source_),
+    format(source.getPixelFormat()),
+    step(step_),
+    screenWidth (source.getScreenWidth ()),
+    screenHeight(source.getScreenHeight()),
+    changeDetection(false),
+    firstFingerprint(true)
+{
+    if(step < 1) throw std::invalid_argument("step must be positive");
+
+    switch(format){
+        case ARGB8888: fingerprintFunction = &ScreenReader::fingerprint<ARGB8888>; break;
+        case ABGR8888: fingerprintFunction = &ScreenReader::fingerprint<ABGR8888>; break;
+        case RGB565  : fingerprintFunction = &ScreenReader::fingerprint<RGB565  >; break;
+        case BGR565  : fingerprintFunction = &ScreenReader::fingerprint<BGR565  >; break;
+        default: throw std::logic_error("No other value is allowed for enum PixelFormat");
     }
 
-    // Map the shared memory segment into the address space of this process
-    info.shmaddr = (char *)shmat(info.shmid, 0, 0);
-    if (info.shmaddr == (char *)-1){
-        throw std::system_error(
-            std::error_code(errno, std::system_category()),
-            "Reading screen"
-        );
+    MARGIN_X = getScreenWidth () / NUM_LEDS_X;
+    MARGIN_Y = getScreenHeight() / NUM_LEDS_Y;
+    if(depth > 0){
+        MARGIN_X = std::min(MARGIN_X, depth);
+        MARGIN_Y = std::min(MARGIN_Y, depth);
     }
 
-    unsigned int *ret = (unsigned int *)info.shmaddr;
-    info.readOnly = false;
+    initRegions();
+}
 
-    // Mark the shared memory segment for removal
-    // It will be removed even if this program crashes
-    shmctl(info.shmid, IPC_RMID, 0);
+int ScreenReader::getScreenWidth (){ return screenWidth ; }
+int ScreenReader::getScreenHeight(){ return screenHeight; }
 
-    // Ask the X server to attach the shared memory segment and sync
-    if (XShmAttach(dsp, &info) == 0){
-            throw std::system_error(
-            std::error_code(errno, std::system_category()),
-            "Could not attach XImage structure"
-        );
-    }
-    XSync(dsp, false);
+size_t ScreenReader::getCapturedPixels() const {
+    size_t n = 0;
+    for(const StripSpan &span: spans) n += size_t(span.width)*span.height;
+    return n;
+}
 
-    return ret;
+size_t ScreenReader::getCapturedBytes() const {
+    return getCapturedPixels() * PixelFormats::getBytesPerPixel(format);
 }
 
-void ScreenReader::initShm(){
-    data_bot = createShm(getScreenWidth(), MARGIN_Y, shminfo_bot);
-    data_top = createShm(getScreenWidth(), MARGIN_Y, shminfo_top);
-    data_lef = createShm(MARGIN_X, getScreenHeight() - 2*MARGIN_Y, shminfo_lef);
-    data_rig = createShm(MARGIN_X, getScreenHeight() - 2*MARGIN_Y, shminfo_rig);
+void ScreenReader::setChangeDetection(bool enabled){
+    changeDetection = enabled;
+    firstFingerprint = true;
+    if(!enabled) return;
+
+    for(int i = 0; i < NUM_STRIPS; ++i){
+        Fingerprints &f = fingerprints[i];
+        f.blocksX = (spans[i].width  + BLOCK_PIXELS-1) / BLOCK_PIXELS;
+        f.blocksY = (spans[i].height + BLOCK_LINES -1) / BLOCK_LINES;
+        f.hashes .assign(size_t(f.blocksX)*f.blocksY, 0);
+        f.changed.assign(size_t(f.blocksX)*f.blocksY, 1);
+        f.anyChanged = true;
+    }
+}
+
+template<PixelFormat F>
+void ScreenReader::fingerprint(Strip strip){
+    const StripSpan &span = spans[strip];
+    Fingerprints &f = fingerprints[strip];
+
+    f.anyChanged = false;
+    for(int by = 0; by < f.blocksY; ++by){
+        const int y0 = by*BLOCK_LINES;
+        const int y1 = std::min(y0 + BLOCK_LINES, span.height);
+        for(int bx = 0; bx < f.blocksX; ++bx){
+            const int x0 = bx*BLOCK_PIXELS;
+            const int n  = std::min(BLOCK_PIXELS, span.width - x0);
+
+            // Combine lines with odd factors too, so a change to one line
+            // always changes the block's fingerprint
+            uint64_t hash = 0;
+            for(int y = y0; y < y1; ++y)
+                hash += hashPixels<F>(span.row<F>(y) + x0, n) * uint64_t(2*(y-y0)+1);
+
+            const size_t i = size_t(by)*f.blocksX + bx;
+            f.changed[i] = (firstFingerprint || hash != f.hashes[i]);
+            f.hashes[i] = hash;
+            f.anyChanged |= f.changed[i];
+        }
+    }
 }
 
-void ScreenReader::initXImage(){
-    // Allocate the memory needed for the XImage structure
-    ximage_bot = XShmCreateImage(dsp, XDefaultVisual(dsp, XDefaultScreen(dsp)), DefaultDepth(dsp, XDefaultScreen(dsp)), ZPixmap, NULL, &shminfo_bot, getScreenWidth(), MARGIN_Y);
-    ximage_lef = XShmCreateImage(dsp, XDefaultVisual(dsp, XDefaultScreen(dsp)), DefaultDepth(dsp, XDefaultScreen(dsp)), ZPixmap, NULL, &shminfo_lef, MARGIN_X, getScreenHeight() - 2*MARGIN_Y);
-    ximage_top = XShmCreateImage(dsp, XDefaultVisual(dsp, XDefaultScreen(dsp)), DefaultDepth(dsp, XDefaultScreen(dsp)), ZPixmap, NULL, &shminfo_top, getScreenWidth(), MARGIN_Y);
-    ximage_rig = XShmCreateImage(dsp, XDefaultVisual(dsp, XDefaultScreen(dsp)), DefaultDepth(dsp, XDefaultScreen(dsp)), ZPixmap, NULL, &shminfo_rig, MARGIN_X, getScreenHeight() - 2*MARGIN_Y);
-
-    if (!ximage_bot || !ximage_lef || !ximage_top || !ximage_rig){
-        throw std::system_error(
-            std::error_code(errno, std::system_category()),
-            "Could not allocate the XImage structures"
-        );
+void ScreenReader::update(){
+    source.grab();
+
+    // Pixels are left as captured: the reduction kernels decode them, and
+    // getPixel converts the single pixel it returns
+    for(int i = 0; i < NUM_STRIPS; ++i){
+        spans[i].data = source.getRegion(handles[i]);
     }
 
-    ximage_bot->data = (char *)data_bot;
-    ximage_lef->data = (char *)data_lef;
-    ximage_top->data = (char *)data_top;
-    ximage_rig->data = (char *)data_rig;
+    if(changeDetection){
+        for(int i = 0; i < NUM_STRIPS; ++i) (this->*fingerprintFunction)(Strip(i));
+        firstFingerprint = false;
+    }
 }
 
-ScreenReader::ScreenReader(int NUM_LEDS_X, int NUM_LEDS_Y){
-    shminfo_bot.shmaddr = (char *)-1;
-    shminfo_lef.shmaddr = (char *)-1;
-    shminfo_top.shmaddr = (char *)-1;
-    shminfo_rig.shmaddr = (char *)-1;
-    initDisplay();
+bool ScreenReader::isChanged(const Rect &region) const {
+    if(!changeDetection) return true;
 
-    MARGIN_X = getScreenWidth () / NUM_LEDS_X;
-    MARGIN_Y = getScreenHeight() / NUM_LEDS_Y;
+    for(int i = 0; i < NUM_STRIPS; ++i){
+        const Fingerprints &f = fingerprints[i];
+        if(!f.anyChanged) continue;
+        const Rect r = spans[i].clip(region);
+        if(r.empty()) continue;
 
-    initShm();
-    initXImage();
+        for(int by = r.y/BLOCK_LINES; by <= (r.bottom()-1)/BLOCK_LINES; ++by){
+            for(int bx = r.x/BLOCK_PIXELS; bx <= (r.right()-1)/BLOCK_PIXELS; ++bx){
+                if(f.changed[size_t(by)*f.blocksX + bx]) return true;
+            }
+        }
+    }
+    return false;
 }
 
-int ScreenReader::getScreenWidth (){ return screenWidth  = XDisplayWidth (dsp, XDefaultScreen(dsp)); }
-int ScreenReader::getScreenHeight(){ return screenHeight = XDisplayHeight(dsp, XDefaultScreen(dsp)); }
+bool ScreenReader::isChanged(Strip strip) const {
+    return !changeDetection || fingerprints[strip].anyChanged;
+}
 
-void ScreenReader::update(){
-    XShmGetImage(dsp, XDefaultRootWindow(dsp), ximage_bot, 0, screenHeight-MARGIN_Y, AllPlanes);
-    XShmGetImage(dsp, XDefaultRootWindow(dsp), ximage_lef, 0, MARGIN_Y, AllPlanes);
-    XShmGetImage(dsp, XDefaultRootWindow(dsp), ximage_top, 0, 0, AllPlanes);
-    XShmGetImage(dsp, XDefaultRootWindow(dsp), ximage_rig, screenWidth-MARGIN_X, MARGIN_Y, AllPlanes);
-
-    // Set alpha channel to 0xff
-    uint32_t *p;
-    p = data_bot; for (int i = 0; i < ximage_bot->height * ximage_bot->width; ++i) *p++ |= 0xff000000;
-    p = data_lef; for (int i = 0; i < ximage_lef->height * ximage_lef->width; ++i) *p++ |= 0xff000000;
-    p = data_top; for (int i = 0; i < ximage_top->height * ximage_top->width; ++i) *p++ |= 0xff000000;
-    p = data_rig; for (int i = 0; i < ximage_rig->height * ximage_rig->width; ++i) *p++ |= 0xff000000;
+template<PixelFormat F>
+uint32_t ScreenReader::decodePixel(const StripSpan &span, int x, int y){
+    return toARGB<F>(span.row<F>(y)[x]);
 }
 
 uint32_t ScreenReader::getPixel(int x, int y){
@@ -124,51 +200,26 @@ uint32_t ScreenReader::getPixel(int x, int y){
         0 <= x && x < screenWidth &&
         0 <= y && y < screenHeight
     )) throw std::invalid_argument("x and y must be within bounds");
-    if(
-        MARGIN_X <= x && x < screenWidth -MARGIN_X &&
-        MARGIN_Y <= y && y < screenHeight-MARGIN_Y
-    ){
-        std::stringstream ss;
-        ss  << "(" << x << ", " << y << ") is outside margins; "
-            << "margins are (" << MARGIN_X << ", " << MARGIN_Y << "); "
-            << "size is (" << screenWidth << ", " << screenHeight << ")";
-        throw std::invalid_argument(ss.str());
-    }
 
-    if(y < MARGIN_Y){ // Top
-        const int dx = x;
-        const int dy = y;
-        return data_top[dy * ximage_top->width + dx];
-    } else if(screenHeight-MARGIN_Y <= y){ // Bottom
-        const int dx = x;
-        const int dy = y - (screenHeight-MARGIN_Y);
-        return data_bot[dy * ximage_bot->width + dx];
-    } else if(x < MARGIN_X){ // Left
-        const int dx = x;
-        const int dy = y-MARGIN_Y;
-        return data_lef[dy * ximage_lef->width + dx];
-    } else if(screenWidth-MARGIN_X <= x){ // Right
-        const int dx = x - (screenWidth-MARGIN_X);
-        const int dy = y-MARGIN_Y;
-        return data_rig[dy * ximage_rig->width + dx];
-    } else {
-        throw std::invalid_argument("Something went wrong");
+    for(const StripSpan &span: spans){
+        const int dx = x - span.rect.x;
+        const int dy = y - span.rect.y;
+        if(0 <= dx && dx < span.rect.width && 0 <= dy && dy < span.rect.height){
+            const int sx = (span.transposed ? dy : dx);
+            const int sy = (span.transposed ? dx : dy) / span.step;
+            switch(format){
+                case ARGB8888: return decodePixel<ARGB8888>(span, sx, sy);
+                case ABGR8888: return decodePixel<ABGR8888>(span, sx, sy);
+                case RGB565  : return decodePixel<RGB565  >(span, sx, sy);
+                case BGR565  : return decodePixel<BGR565  >(span, sx, sy);
+                default: throw std::logic_error("No other value is allowed for enum PixelFormat");
+            }
+        }
     }
-}
-
-ScreenReader::~ScreenReader(){
-    if (ximage_bot){ XShmDetach(dsp, &shminfo_bot); XDestroyImage(ximage_bot); ximage_bot = nullptr; }
-    if (ximage_lef){ XShmDetach(dsp, &shminfo_lef); XDestroyImage(ximage_lef); ximage_lef = nullptr; }
-    if (ximage_top){ XShmDetach(dsp, &shminfo_top); XDestroyImage(ximage_top); ximage_top = nullptr; }
-    if (ximage_rig){ XShmDetach(dsp, &shminfo_rig); XDestroyImage(ximage_rig); ximage_rig = nullptr; }
 
-    if (shminfo_bot.shmaddr != (char *)-1){ shmdt(shminfo_bot.shmaddr); shminfo_bot.shmaddr = (char *)-1; }
-    if (shminfo_lef.shmaddr != (char *)-1){ shmdt(shminfo_lef.shmaddr); shminfo_lef.shmaddr = (char *)-1; }
-    if (shminfo_top.shmaddr != (char *)-1){ shmdt(shminfo_top.shmaddr); shminfo_top.shmaddr = (char *)-1; }
-    if (shminfo_rig.shmaddr != (char *)-1){ shmdt(shminfo_rig.shmaddr); shminfo_rig.shmaddr = (char *)-1; }
-
-    if(dsp){
-        XCloseDisplay(dsp);
-    }
+    std::stringstream ss;
+    ss  << "(" << x << ", " << y << ") is outside margins; "
+        << "margins are (" << MARGIN_X << ", " << MARGIN_Y << "); "
+        << "size is (" << screenWidth << ", " << screenHeight << ")";
+    throw std::invalid_argument(ss.str());
 }
-
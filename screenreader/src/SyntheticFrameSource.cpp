@@ -0,0 +1,120 @@
+#include "SyntheticFrameSource.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+SyntheticFrameSource::SyntheticFrameSource(int screenWidth_, int screenHeight_, Pattern pattern_, PixelFormat format_):
+    screenWidth (screenWidth_ ),
+    screenHeight(screenHeight_),
+    pattern(pattern_),
+    format(format_),
+    frame(0)
+{
+    if(screenWidth <= 0 || screenHeight <= 0)
+        throw std::invalid_argument("Screen size must be positive");
+}
+
+SyntheticFrameSource::Pattern SyntheticFrameSource::parsePattern(const std::string &s){
+    if(s == "black"   ) return BLACK;
+    if(s == "static"  ) return STATIC;
+    if(s == "gradient") return GRADIENT;
+    if(s == "noise"   ) return NOISE;
+    throw std::invalid_argument("Unknown synthetic pattern '" + s + "'");
+}
+
+int SyntheticFrameSource::getScreenWidth (){ return screenWidth ; }
+int SyntheticFrameSource::getScreenHeight(){ return screenHeight; }
+PixelFormat SyntheticFrameSource::getPixelFormat(){ return format; }
+
+int SyntheticFrameSource::addRegion(const std::vector<Rect> &parts){
+    size_t size = 0;
+    for(const Rect &rect: parts){
+        if(
+            rect.x < 0 || rect.right () > screenWidth  ||
+            rect.y < 0 || rect.bottom() > screenHeight ||
+            rect.empty()
+        ) throw std::invalid_argument("Region must be non-empty and within screen bounds");
+        size += size_t(rect.width) * rect.height;
+    }
+
+    Region region;
+    region.parts = parts;
+    region.data.resize(size);
+    if(format != ARGB8888){
+        const size_t bytes = size * PixelFormats::getBytesPerPixel(format);
+        region.converted.resize((bytes + 3) / 4);
+    }
+    render(region);
+    regions.push_back(region);
+    return regions.size()-1;
+}
+
+void SyntheticFrameSource::render(Region &region){
+    uint32_t *p = region.data.data();
+    for(const Rect &rect: region.parts){
+        render(rect, p);
+        p += size_t(rect.width) * rect.height;
+    }
+
+    switch(format){
+        case ARGB8888: break;
+        case ABGR8888: convert<ABGR8888>(region); break;
+        case RGB565  : convert<RGB565  >(region); break;
+        case BGR565  : convert<BGR565  >(region); break;
+        default: throw std::logic_error("No other value is allowed for enum PixelFormat");
+    }
+}
+
+template<PixelFormat F>
+void SyntheticFrameSource::convert(Region &region){
+    typename PixelTraits<F>::Pixel *dest = (typename PixelTraits<F>::Pixel*)region.converted.data();
+    for(size_t i = 0; i < region.data.size(); ++i) dest[i] = fromARGB<F>(region.data[i]);
+}
+
+void SyntheticFrameSource::render(const Rect &rect, uint32_t *p){
+    const size_t size = size_t(rect.width) * rect.height;
+
+    switch(pattern){
+        case BLACK:
+            std::fill(p, p + size, 0xff000000);
+            break;
+        case STATIC:
+        case GRADIENT: {
+            const uint32_t shift = (pattern == GRADIENT ? uint32_t(frame*4) : 0);
+            std::vector<uint32_t> column(rect.width);
+            for(int dx = 0; dx < rect.width; ++dx)
+                column[dx] = ((uint32_t(rect.x + dx) * 256 / screenWidth) + shift) & 0xff;
+            for(int dy = 0; dy < rect.height; ++dy){
+                const uint32_t g = ((uint32_t(rect.y + dy) * 256 / screenHeight) + shift) & 0xff;
+                for(int dx = 0; dx < rect.width; ++dx){
+                    const uint32_t r = column[dx];
+                    *(p++) = 0xff000000 | (r << 16) | (g << 8) | (r ^ g);
+                }
+            }
+            break;
+        }
+        case NOISE: {
+            // xorshift64, seeded per frame and part so frames are reproducible
+            uint64_t state = 0x9E3779B97F4A7C15ULL * (frame + 1) + uint64_t(rect.x) * 31 + rect.y;
+            for(size_t i = 0; i < size; ++i){
+                state ^= state << 13;
+                state ^= state >>  7;
+                state ^= state << 17;
+                *(p++) = 0xff000000 | uint32_t(state);
+            }
+            break;
+        }
+        default: throw std::logic_error("No other value is allowed for enum Pattern");
+    }
+}
+
+void SyntheticFrameSource::grab(){
+    ++frame;
+    if(pattern == BLACK || pattern == STATIC) return;
+    for(Region &region: regions) render(region);
+}
+
+const void *SyntheticFrameSource::getRegion(int handle){
+    const Region &region = regions.at(handle);
+    return (format == ARGB8888 ? region.data.data() : region.converted.data());
+}
@@ -0,0 +1,155 @@
+#include "TraceFrameSource.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+TraceFrameSource::TraceFrameSource(const std::string &path):
+    fd(-1),
+    file(nullptr),
+    fileSize(0),
+    numFrames(0),
+    frame(0),
+    current(nullptr)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not open trace file " + path
+        );
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        std::error_code ec(errno, std::system_category());
+        close(fd);
+        throw std::system_error(ec, "Could not stat trace file " + path);
+    }
+    fileSize = st.st_size;
+
+    if(fileSize > 0){
+        void *p = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED){
+            std::error_code ec(errno, std::system_category());
+            close(fd);
+            throw std::system_error(ec, "Could not map trace file " + path);
+        }
+        file = (const uint8_t *)p;
+        madvise(p, fileSize, MADV_SEQUENTIAL);
+    }
+
+    try {
+        parse(path);
+    } catch(...){
+        if(file) munmap((void*)file, fileSize);
+        close(fd);
+        throw;
+    }
+
+    // The first grab returns the first frame
+    frame = numFrames - 1;
+    current = file + header.headerSize + frame * header.frameSize;
+}
+
+void TraceFrameSource::parse(const std::string &path){
+    const std::string invalid = "Invalid trace file " + path + ": ";
+
+    if(fileSize < sizeof(header)) throw std::invalid_argument(invalid + "too short");
+    memcpy(&header, file, sizeof(header));
+    if(memcmp(header.magic, TraceFile::MAGIC, sizeof(header.magic)) != 0)
+        throw std::invalid_argument(invalid + "bad magic");
+    if(header.version != TraceFile::VERSION)
+        throw std::invalid_argument(invalid + "unsupported version " + std::to_string(header.version));
+    if(header.pixelFormat >= NUM_PIXEL_FORMATS)
+        throw std::invalid_argument(invalid + "unknown pixel format");
+    if(header.screenWidth <= 0 || header.screenHeight <= 0)
+        throw std::invalid_argument(invalid + "screen size must be positive");
+    if(header.headerSize != TraceFile::getHeaderSize(header.numParts) || header.headerSize > fileSize)
+        throw std::invalid_argument(invalid + "bad header size");
+
+    const int bytesPerPixel = PixelFormats::getBytesPerPixel(PixelFormat(header.pixelFormat));
+    regions.resize(header.numRegions);
+    const uint8_t *p = file + sizeof(header);
+    for(uint32_t i = 0; i < header.numParts; ++i, p += sizeof(TraceFile::PartRecord)){
+        TraceFile::PartRecord record;
+        memcpy(&record, p, sizeof(record));
+        const Rect rect(record.x, record.y, record.width, record.height);
+        if(
+            record.region >= header.numRegions ||
+            rect.x < 0 || rect.right () > header.screenWidth  ||
+            rect.y < 0 || rect.bottom() > header.screenHeight ||
+            rect.empty()
+        ) throw std::invalid_argument(invalid + "bad region");
+        regions[record.region].parts.push_back(rect);
+    }
+
+    // Regions follow the frame header, each padded like the recorder does
+    size_t offset = sizeof(TraceFile::FrameHeader);
+    for(Region &region: regions){
+        size_t size = 0;
+        for(const Rect &rect: region.parts) size += size_t(rect.width) * rect.height;
+        region.offset = offset;
+        region.registered = false;
+        offset += TraceFile::align(size * bytesPerPixel);
+    }
+    if(offset != header.frameSize) throw std::invalid_argument(invalid + "bad frame size");
+
+    numFrames = (fileSize - header.headerSize) / header.frameSize;
+    if(numFrames == 0) throw std::invalid_argument("Trace file " + path + " contains no frames");
+}
+
+int TraceFrameSource::getScreenWidth (){ return header.screenWidth ; }
+int TraceFrameSource::getScreenHeight(){ return header.screenHeight; }
+PixelFormat TraceFrameSource::getPixelFormat(){ return PixelFormat(header.pixelFormat); }
+
+int TraceFrameSource::addRegion(const std::vector<Rect> &parts){
+    for(size_t i = 0; i < regions.size(); ++i){
+        Region &region = regions[i];
+        if(region.registered || region.parts.size() != parts.size()) continue;
+
+        bool same = true;
+        for(size_t j = 0; j < parts.size() && same; ++j){
+            const Rect &a = region.parts[j], &b = parts[j];
+            same = (a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height);
+        }
+        if(!same) continue;
+
+        region.registered = true;
+        handles.push_back(i);
+        return handles.size()-1;
+    }
+    throw std::invalid_argument("Region was not recorded in the trace; replay it with the layout, depth and step it was recorded with");
+}
+
+void TraceFrameSource::grab(){
+    frame = (frame + 1) % numFrames;
+    current = file + header.headerSize + frame * header.frameSize;
+}
+
+const void *TraceFrameSource::getRegion(int handle){
+    return current + regions[handles.at(handle)].offset;
+}
+
+size_t TraceFrameSource::getNumFrames() const {
+    return numFrames;
+}
+
+uint64_t TraceFrameSource::getDurationNanos() const {
+    const TraceFile::FrameHeader *first = (const TraceFile::FrameHeader *)(file + header.headerSize);
+    const TraceFile::FrameHeader *last  = (const TraceFile::FrameHeader *)(file + header.headerSize + (numFrames-1) * header.frameSize);
+    return last->captureStart - first->captureStart;
+}
+
+const TraceFile::FrameHeader &TraceFrameSource::getFrameHeader() const {
+    return *(const TraceFile::FrameHeader *)current;
+}
+
+TraceFrameSource::~TraceFrameSource(){
+    if(file) munmap((void*)file, fileSize);
+    if(fd != -1) close(fd);
+}
@@ -0,0 +1,154 @@
+#include "TraceRecorder.h"
+#include "TraceFile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <system_error>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+const uint8_t ZEROES[TraceFile::ALIGNMENT] = {};
+
+uint64_t monotonicNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+}
+
+TraceRecorder::TraceRecorder(FrameSource *source_, const std::string &path_):
+    source(source_),
+    path(path_),
+    fd(-1),
+    frameSize(sizeof(TraceFile::FrameHeader)),
+    frames(0),
+    started(false)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not create trace file " + path
+        );
+    }
+}
+
+int TraceRecorder::getScreenWidth (){ return source->getScreenWidth (); }
+int TraceRecorder::getScreenHeight(){ return source->getScreenHeight(); }
+PixelFormat TraceRecorder::getPixelFormat(){ return source->getPixelFormat(); }
+
+int TraceRecorder::addRegion(const std::vector<Rect> &parts){
+    if(started) throw std::logic_error("Regions cannot be added once recording has started");
+
+    const int handle = source->addRegion(parts);
+    if(handle != int(regions.size())) throw std::logic_error("Recorded source returned an unexpected handle");
+
+    Region region;
+    region.parts = parts;
+    region.size = 0;
+    for(const Rect &rect: parts) region.size += size_t(rect.width) * rect.height;
+    region.size *= PixelFormats::getBytesPerPixel(source->getPixelFormat());
+    region.padding = TraceFile::align(region.size) - region.size;
+    regions.push_back(region);
+
+    frameSize += region.size + region.padding;
+    return handle;
+}
+
+bool TraceRecorder::writeAll(const struct iovec *iov, int count, size_t size){
+    // Writes to a regular file are only short if the disk is full or on
+    // error, in which case the trace is over anyway
+    const ssize_t written = writev(fd, iov, count);
+    if(written == ssize_t(size)) return true;
+    stop(written < 0 ? strerror(errno) : "short write");
+    return false;
+}
+
+void TraceRecorder::writeHeader(){
+    std::vector<uint8_t> buffer;
+    uint32_t numParts = 0;
+    for(const Region &region: regions) numParts += region.parts.size();
+    buffer.resize(TraceFile::getHeaderSize(numParts));
+
+    TraceFile::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TraceFile::MAGIC, sizeof(header.magic));
+    header.version      = TraceFile::VERSION;
+    header.headerSize   = buffer.size();
+    header.screenWidth  = source->getScreenWidth ();
+    header.screenHeight = source->getScreenHeight();
+    header.pixelFormat  = source->getPixelFormat();
+    header.numRegions   = regions.size();
+    header.numParts     = numParts;
+    header.frameSize    = frameSize;
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    uint8_t *p = buffer.data() + sizeof(header);
+    for(size_t i = 0; i < regions.size(); ++i){
+        for(const Rect &rect: regions[i].parts){
+            const TraceFile::PartRecord part = {uint32_t(i), rect.x, rect.y, rect.width, rect.height};
+            memcpy(p, &part, sizeof(part));
+            p += sizeof(part);
+        }
+    }
+
+    struct iovec iov = {buffer.data(), buffer.size()};
+    writeAll(&iov, 1, buffer.size());
+}
+
+void TraceRecorder::writeFrame(uint64_t captureStart, uint64_t captureEnd){
+    TraceFile::FrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.number       = frames;
+    header.captureStart = captureStart;
+    header.captureEnd   = captureEnd;
+
+    std::vector<struct iovec> iov;
+    iov.reserve(1 + 2*regions.size());
+    iov.push_back({&header, sizeof(header)});
+    for(size_t i = 0; i < regions.size(); ++i){
+        iov.push_back({const_cast<void*>(source->getRegion(i)), regions[i].size});
+        if(regions[i].padding) iov.push_back({const_cast<uint8_t*>(ZEROES), regions[i].padding});
+    }
+
+    if(writeAll(iov.data(), iov.size(), frameSize)) ++frames;
+}
+
+void TraceRecorder::stop(const char *what){
+    fprintf(stderr, "[TRACE] Stopped recording %s after %llu frames: %s\n", path.c_str(), (unsigned long long)frames, what);
+    close(fd);
+    fd = -1;
+}
+
+void TraceRecorder::grab(){
+    const uint64_t captureStart = monotonicNanos();
+    source->grab();
+    const uint64_t captureEnd = monotonicNanos();
+
+    if(!started){
+        started = true;
+        if(fd != -1) writeHeader();
+    }
+    if(fd != -1) writeFrame(captureStart, captureEnd);
+}
+
+const void *TraceRecorder::getRegion(int handle){
+    return source->getRegion(handle);
+}
+
+bool TraceRecorder::isBlanked(){
+    return source->isBlanked();
+}
+
+uint64_t TraceRecorder::getNumFrames() const {
+    return frames;
+}
+
+TraceRecorder::~TraceRecorder(){
+    if(fd != -1) close(fd);
+}
@@ -0,0 +1,112 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <climits>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+void futexWait(std::atomic<uint32_t> &word, uint32_t value){
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+void futexWake(std::atomic<uint32_t> &word){
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+}
+
+WorkerPool::WorkerPool(int numThreads_):
+    numThreads(numThreads_),
+    ranges(std::max(numThreads_, 1)),
+    task(nullptr),
+    grain(1),
+    generation(0),
+    remaining(0),
+    stopping(false)
+{
+    if(numThreads < 1) throw std::invalid_argument("A pool needs at least one thread");
+
+    for(int i = 1; i < numThreads; ++i)
+        threads.push_back(std::thread(&WorkerPool::loop, this, i));
+}
+
+int WorkerPool::getNumThreads() const { return numThreads; }
+
+void WorkerPool::work(int self){
+    // Own share first, then the others', in the same chunks
+    for(int k = 0; k < numThreads; ++k){
+        Range &range = ranges[(self + k) % numThreads];
+        while(true){
+            const size_t begin = range.next.fetch_add(grain, std::memory_order_relaxed);
+            if(begin >= range.end) break;
+            task->execute(begin, std::min(begin + grain, range.end));
+        }
+    }
+}
+
+void WorkerPool::loop(int self){
+    uint32_t seen = 0;
+    while(true){
+        // Spin for a while, as jobs come in bursts, then sleep
+        uint32_t current;
+        int spins = 0;
+        while((current = generation.load(std::memory_order_acquire)) == seen){
+            if(++spins < SPIN_ITERATIONS) cpuRelax();
+            else futexWait(generation, seen);
+        }
+        seen = current;
+
+        if(stopping.load(std::memory_order_relaxed)) return;
+
+        work(self);
+
+        if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            futexWake(remaining);
+    }
+}
+
+void WorkerPool::run(Task &task_, size_t numItems, size_t grain_){
+    if(numThreads == 1 || numItems <= 1){
+        if(numItems > 0) task_.execute(0, numItems);
+        return;
+    }
+
+    task = &task_;
+    // Several chunks per thread, so there is something left to steal
+    grain = (grain_ ? grain_ : std::max<size_t>(1, numItems / (size_t(numThreads)*8)));
+    for(int i = 0; i < numThreads; ++i){
+        ranges[i].next.store(numItems *  i    / numThreads, std::memory_order_relaxed);
+        ranges[i].end =      numItems * (i+1) / numThreads;
+    }
+    remaining.store(numThreads-1, std::memory_order_relaxed);
+
+    generation.fetch_add(1, std::memory_order_release);
+    futexWake(generation);
+
+    work(0);
+
+    uint32_t left;
+    int spins = 0;
+    while((left = remaining.load(std::memory_order_acquire)) != 0){
+        if(++spins < SPIN_ITERATIONS) cpuRelax();
+        else futexWait(remaining, left);
+    }
+    task = nullptr;
+}
+
+WorkerPool::~WorkerPool(){
+    stopping.store(true, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    futexWake(generation);
+    for(std::thread &thread: threads) thread.join();
+}
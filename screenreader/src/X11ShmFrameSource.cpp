@@ -0,0 +1,210 @@
+#include "X11ShmFrameSource.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <X11/extensions/dpms.h>
+
+void X11ShmFrameSource::initDisplay(const char *displayName){
+    dsp = XOpenDisplay(displayName);
+    if (!dsp){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not open a connection to the X server"
+        );
+    }
+
+    if (!XShmQueryExtension(dsp)){
+        std::error_code ec(errno, std::system_category());
+        XCloseDisplay(dsp);
+        dsp = NULL;
+        throw std::system_error(
+            ec,
+            "The X server does not support the XSHM extension\n"
+        );
+    }
+}
+
+void X11ShmFrameSource::initPixelFormat(){
+    const int screen = XDefaultScreen(dsp);
+    const Visual *visual = XDefaultVisual(dsp, screen);
+    const int depth = DefaultDepth(dsp, screen);
+
+    // Images of a depth may use more bits per pixel, e.g. 32 for depth 24
+    int bitsPerPixel = 0, numFormats = 0;
+    XPixmapFormatValues *formats = XListPixmapFormats(dsp, &numFormats);
+    for(int i = 0; i < numFormats; ++i){
+        if(formats[i].depth == depth) bitsPerPixel = formats[i].bits_per_pixel;
+    }
+    if(formats) XFree(formats);
+
+    if(ImageByteOrder(dsp) != LSBFirst)
+        throw std::invalid_argument("Only servers with little-endian images are supported");
+
+    format = PixelFormats::fromMasks(bitsPerPixel, visual->red_mask, visual->green_mask, visual->blue_mask);
+    bytesPerPixel = PixelFormats::getBytesPerPixel(format);
+}
+
+uint8_t *X11ShmFrameSource::createShm(size_t numPixels, XShmSegmentInfo &info){
+    // Create a shared memory area
+    info.shmid = shmget(IPC_PRIVATE, numPixels * bytesPerPixel, IPC_CREAT | 0600);
+    if (info.shmid == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Reading screen"
+        );
+    }
+
+    // Map the shared memory segment into the address space of this process
+    info.shmaddr = (char *)shmat(info.shmid, 0, 0);
+    if (info.shmaddr == (char *)-1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Reading screen"
+        );
+    }
+
+    uint8_t *ret = (uint8_t *)info.shmaddr;
+    info.readOnly = false;
+
+    // Mark the shared memory segment for removal
+    // It will be removed even if this program crashes
+    shmctl(info.shmid, IPC_RMID, 0);
+
+    // Ask the X server to attach the shared memory segment and sync
+    if (XShmAttach(dsp, &info) == 0){
+            throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not attach XImage structure"
+        );
+    }
+    XSync(dsp, false);
+
+    return ret;
+}
+
+X11ShmFrameSource::X11ShmFrameSource(const char *displayName){
+    initDisplay(displayName);
+
+    screenWidth  = XDisplayWidth (dsp, XDefaultScreen(dsp));
+    screenHeight = XDisplayHeight(dsp, XDefaultScreen(dsp));
+
+    try {
+        initPixelFormat();
+    } catch(const std::invalid_argument &e){
+        XCloseDisplay(dsp);
+        dsp = NULL;
+        throw;
+    }
+
+    int eventBase, errorBase;
+    dpms = DPMSQueryExtension(dsp, &eventBase, &errorBase) && DPMSCapable(dsp);
+}
+
+int X11ShmFrameSource::getScreenWidth (){ return screenWidth ; }
+int X11ShmFrameSource::getScreenHeight(){ return screenHeight; }
+PixelFormat X11ShmFrameSource::getPixelFormat(){ return format; }
+
+int X11ShmFrameSource::addRegion(const std::vector<Rect> &parts){
+    if(parts.empty()) throw std::invalid_argument("Region must have at least one part");
+    size_t numPixels = 0;
+    Rect bounds = parts.front();
+    for(const Rect &rect: parts){
+        if(
+            rect.x < 0 || rect.right () > screenWidth  ||
+            rect.y < 0 || rect.bottom() > screenHeight ||
+            rect.empty()
+        ) throw std::invalid_argument("Region must be non-empty and within screen bounds");
+        numPixels += size_t(rect.width) * rect.height;
+        bounds = bounds.unite(rect);
+    }
+
+    regions.push_back(Region());
+    Region &region = regions.back();
+    region.parts = parts;
+    region.bounds = bounds;
+    region.shminfo.shmaddr = (char *)-1;
+    region.ximage = NULL;
+
+    // Allocate the memory needed for the XImage structure
+    region.ximage = XShmCreateImage(
+        dsp,
+        XDefaultVisual(dsp, XDefaultScreen(dsp)),
+        DefaultDepth(dsp, XDefaultScreen(dsp)),
+        ZPixmap, NULL, &region.shminfo,
+        bounds.width, bounds.height
+    );
+    if (!region.ximage){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Could not allocate the XImage structure"
+        );
+    }
+    // Rows of the image may be padded
+    const size_t segmentBytes = size_t(region.ximage->bytes_per_line) * bounds.height;
+    uint8_t *segment = createShm((segmentBytes + bytesPerPixel-1) / bytesPerPixel, region.shminfo);
+    region.ximage->data = (char *)segment;
+
+    // Only a single part whose rows are not padded (as they are for odd
+    // widths at 16 bits per pixel) can be returned as it is
+    if(parts.size() == 1 && region.ximage->bytes_per_line == bounds.width * bytesPerPixel){
+        region.data = segment;
+    } else {
+        region.packed.assign(numPixels * bytesPerPixel, 0);
+        region.data = region.packed.data();
+    }
+
+    return regions.size()-1;
+}
+
+void X11ShmFrameSource::grab(){
+    for(Region &region: regions){
+        const Rect &bounds = region.bounds;
+        XShmGetImage(dsp, XDefaultRootWindow(dsp), region.ximage, bounds.x, bounds.y, AllPlanes);
+        if(region.data == (const uint8_t *)region.ximage->data) continue;
+
+        // Copy each part out of the bounding rectangle, row by row
+        const uint8_t *segment = (const uint8_t *)region.ximage->data;
+        const size_t stride = size_t(region.ximage->bytes_per_line);
+        uint8_t *dest = region.data;
+        for(const Rect &rect: region.parts){
+            const size_t rowBytes = size_t(rect.width) * bytesPerPixel;
+            const uint8_t *src = segment + size_t(rect.y - bounds.y) * stride + size_t(rect.x - bounds.x) * bytesPerPixel;
+            for(int y = 0; y < rect.height; ++y, src += stride, dest += rowBytes)
+                memcpy(dest, src, rowBytes);
+        }
+    }
+}
+
+const void *X11ShmFrameSource::getRegion(int handle){
+    return regions.at(handle).data;
+}
+
+bool X11ShmFrameSource::isBlanked(){
+    if(!dpms) return false;
+
+    CARD16 level;
+    BOOL enabled;
+    if(!DPMSInfo(dsp, &level, &enabled)) return false;
+    return enabled && level != DPMSModeOn;
+}
+
+X11ShmFrameSource::~X11ShmFrameSource(){
+    for(Region &region: regions){
+        if (region.ximage){
+            XShmDetach(dsp, &region.shminfo);
+            // The segment is owned by shminfo, not by the XImage
+            region.ximage->data = NULL;
+            XDestroyImage(region.ximage);
+            region.ximage = NULL;
+        }
+        if (region.shminfo.shmaddr != (char *)-1){
+            shmdt(region.shminfo.shmaddr);
+            region.shminfo.shmaddr = (char *)-1;
+        }
+    }
+
+    if(dsp){
+        XCloseDisplay(dsp);
+    }
+}
@@ -0,0 +1,227 @@
+#include "XcbShmFrameSource.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/shm.h>
+#include <system_error>
+#include <time.h>
+
+namespace {
+uint64_t monotonicNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+}
+
+XcbShmFrameSource::XcbShmFrameSource(const char *displayName):
+    current(0),
+    pending(false),
+    requestTime(0)
+{
+    int screenNumber;
+    connection = xcb_connect(displayName, &screenNumber);
+    if(xcb_connection_has_error(connection)){
+        xcb_disconnect(connection);
+        throw std::runtime_error("Could not open a connection to the X server");
+    }
+
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(connection, &xcb_shm_id);
+    if(!ext || !ext->present){
+        xcb_disconnect(connection);
+        throw std::runtime_error("The X server does not support the MIT-SHM extension");
+    }
+
+    xcb_screen_iterator_t it = xcb_setup_roots_iterator(xcb_get_setup(connection));
+    for(int i = 0; i < screenNumber; ++i) xcb_screen_next(&it);
+    const xcb_screen_t *screen = it.data;
+    const xcb_setup_t *setup = xcb_get_setup(connection);
+
+    // Images of a depth may use more bits per pixel, e.g. 32 for depth 24
+    // and rows are padded to scanlinePad bits
+    int bitsPerPixel = 0, scanlinePad = 8;
+    for(xcb_format_iterator_t f = xcb_setup_pixmap_formats_iterator(setup); f.rem; xcb_format_next(&f)){
+        if(f.data->depth == screen->root_depth){
+            bitsPerPixel = f.data->bits_per_pixel;
+            scanlinePad  = f.data->scanline_pad;
+        }
+    }
+    const xcb_visualtype_t *visual = nullptr;
+    for(xcb_depth_iterator_t d = xcb_screen_allowed_depths_iterator(screen); d.rem && !visual; xcb_depth_next(&d)){
+        for(xcb_visualtype_iterator_t v = xcb_depth_visuals_iterator(d.data); v.rem; xcb_visualtype_next(&v)){
+            if(v.data->visual_id == screen->root_visual){ visual = v.data; break; }
+        }
+    }
+    try {
+        if(!visual) throw std::invalid_argument("Could not find the visual of the root window");
+        if(setup->image_byte_order != XCB_IMAGE_ORDER_LSB_FIRST)
+            throw std::invalid_argument("Only servers with little-endian images are supported");
+        format = PixelFormats::fromMasks(bitsPerPixel, visual->red_mask, visual->green_mask, visual->blue_mask);
+    } catch(const std::invalid_argument &e){
+        xcb_disconnect(connection);
+        throw;
+    }
+    bytesPerPixel = PixelFormats::getBytesPerPixel(format);
+    scanlinePadBytes = std::max(scanlinePad / 8, 1);
+
+    root         = screen->root;
+    screenWidth  = screen->width_in_pixels;
+    screenHeight = screen->height_in_pixels;
+}
+
+int XcbShmFrameSource::getScreenWidth (){ return screenWidth ; }
+int XcbShmFrameSource::getScreenHeight(){ return screenHeight; }
+PixelFormat XcbShmFrameSource::getPixelFormat(){ return format; }
+
+size_t XcbShmFrameSource::getStride(const Rect &rect) const {
+    const size_t rowBytes = size_t(rect.width) * bytesPerPixel;
+    return (rowBytes + scanlinePadBytes-1) / scanlinePadBytes * scanlinePadBytes;
+}
+
+int XcbShmFrameSource::addRegion(const std::vector<Rect> &parts){
+    if(pending) throw std::logic_error("Regions must be added before the first grab");
+
+    size_t numPixels = 0, bufferBytes = 0;
+    bool padded = false;
+    for(const Rect &rect: parts){
+        if(
+            rect.x < 0 || rect.right () > screenWidth  ||
+            rect.y < 0 || rect.bottom() > screenHeight ||
+            rect.empty()
+        ) throw std::invalid_argument("Region must be non-empty and within screen bounds");
+        numPixels += size_t(rect.width) * rect.height;
+        bufferBytes += getStride(rect) * rect.height;
+        padded |= (getStride(rect) != size_t(rect.width) * bytesPerPixel);
+    }
+
+    regions.push_back(Region());
+    Region &region = regions.back();
+    region.parts = parts;
+    region.bufferBytes = bufferBytes;
+    region.data = nullptr;
+    if(padded) region.packed.assign(numPixels * bytesPerPixel, 0);
+
+    // Create a shared memory area for both buffers
+    region.shmid = shmget(IPC_PRIVATE, NUM_BUFFERS * bufferBytes, IPC_CREAT | 0600);
+    if(region.shmid == -1){
+        throw std::system_error(
+            std::error_code(errno, std::system_category()),
+            "Reading screen"
+        );
+    }
+
+    void *p = shmat(region.shmid, 0, 0);
+    if(p == (void *)-1){
+        std::error_code ec(errno, std::system_category());
+        shmctl(region.shmid, IPC_RMID, 0);
+        throw std::system_error(ec, "Reading screen");
+    }
+    region.data = (uint8_t *)p;
+
+    // Ask the X server to attach the segment, then mark it for removal
+    // once both sides have detached
+    region.shmseg = xcb_generate_id(connection);
+    xcb_generic_error_t *error = xcb_request_check(
+        connection,
+        xcb_shm_attach_checked(connection, region.shmseg, region.shmid, false)
+    );
+    shmctl(region.shmid, IPC_RMID, 0);
+    if(error){
+        free(error);
+        shmdt(region.data);
+        region.data = nullptr;
+        throw std::runtime_error("Could not attach the shared memory segment");
+    }
+
+    return regions.size()-1;
+}
+
+void XcbShmFrameSource::request(int buffer){
+    for(Region &region: regions){
+        region.cookies.clear();
+        uint32_t offset = uint32_t(buffer * region.bufferBytes);
+        for(const Rect &rect: region.parts){
+            region.cookies.push_back(xcb_shm_get_image(
+                connection, root,
+                rect.x, rect.y, rect.width, rect.height,
+                ~0u, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                region.shmseg, offset
+            ));
+            offset += uint32_t(getStride(rect) * rect.height);
+        }
+    }
+    xcb_flush(connection);
+    pending = true;
+    requestTime = monotonicNanos();
+}
+
+void XcbShmFrameSource::wait(){
+    bool ok = true;
+    for(Region &region: regions){
+        for(const xcb_shm_get_image_cookie_t &cookie: region.cookies){
+            xcb_generic_error_t *error = nullptr;
+            xcb_shm_get_image_reply_t *reply = xcb_shm_get_image_reply(connection, cookie, &error);
+            if(!reply) ok = false;
+            free(reply);
+            free(error);
+        }
+        region.cookies.clear();
+    }
+    pending = false;
+
+    if(!ok) throw std::runtime_error("Could not capture the screen");
+}
+
+void XcbShmFrameSource::grab(){
+    const int next = 1 - current;
+    if(!pending){
+        request(next);
+    } else if(monotonicNanos() - requestTime > MAX_PIPELINED_AGE_NANOS){
+        // Grabs slowed down, e.g. while the screen is idle: drop the frame
+        // requested by the last grab and capture a current one
+        wait();
+        request(next);
+    }
+    wait();
+    current = next;
+
+    // Capture the following frame while this one is being processed
+    request(1 - current);
+
+    // Copy the rows of padded regions out of the buffer just received
+    for(Region &region: regions){
+        if(region.packed.empty()) continue;
+        const uint8_t *src = region.data + current * region.bufferBytes;
+        uint8_t *dest = region.packed.data();
+        for(const Rect &rect: region.parts){
+            const size_t rowBytes = size_t(rect.width) * bytesPerPixel;
+            const size_t stride = getStride(rect);
+            for(int y = 0; y < rect.height; ++y, src += stride, dest += rowBytes)
+                memcpy(dest, src, rowBytes);
+        }
+    }
+}
+
+const void *XcbShmFrameSource::getRegion(int handle){
+    const Region &region = regions.at(handle);
+    if(!region.packed.empty()) return region.packed.data();
+    return region.data + current * region.bufferBytes;
+}
+
+XcbShmFrameSource::~XcbShmFrameSource(){
+    if(pending){
+        try { wait(); } catch(const std::runtime_error &e){}
+    }
+
+    for(Region &region: regions){
+        if(region.data){
+            xcb_shm_detach(connection, region.shmseg);
+            shmdt(region.data);
+            region.data = nullptr;
+        }
+    }
+    xcb_flush(connection);
+    xcb_disconnect(connection);
+}
@@ -1,35 +1,54 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
-#include <semaphore.h>
+#include <memory>
+#include <pthread.h>
 #include <signal.h>
+#include <stdexcept>
+#include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
+
+#include "X11ShmFrameSource.h"
+#ifdef USE_XCB
+#include "XcbShmFrameSource.h"
+#endif
+#include "SyntheticFrameSource.h"
+#include "FileFrameSource.h"
+#include "TraceFrameSource.h"
+#include "TraceRecorder.h"
+#include "CaptureChain.h"
+#include "Kernels.h"
+#include "FrameScheduler.h"
+#include "RateGovernor.h"
+#include "LatencyTracker.h"
+#include "PerfProfiler.h"
+#include "LedShm.h"
+
+int NUM_LEDS_TOTAL;
+std::vector<LedLayout::Edge> LED_EDGES;
+// Index of the first LED of each chain
+std::vector<int> LED_CHAIN_STARTS;
+
+const int64_t MILLIS_TO_NANOS = 1000000;
 
-#include "ScreenReader.h"
-#include "ScreenProcessor.h"
-#include "LedProcessor.h"
-
-const int NUM_LEDS_WIDTH = 32;
-const int NUM_LEDS_HEIGHT = 20;
-const int NUM_LEDS_TOTAL = 2 * (NUM_LEDS_WIDTH + NUM_LEDS_HEIGHT);
-
-const long MILLIS_TO_NANOS = 1000000;
-
-const char SHM_NAME[] = "/shm_leds";
-const char SEM_NAME[] = "/sem_leds";
 const mode_t SHM_MODE = 0777;
-const off_t SHM_SIZE = NUM_LEDS_TOTAL*3 + 2; // +2 for a 16bit integer denoting intensity
+off_t SHM_SIZE;
+uint32_t SHM_NUM_FRAMES = LedShm::DEFAULT_NUM_FRAMES;
 
 const uint16_t INITIAL_INTENSITY = 100;
 
 int shm_fd;
 void *shm = NULL;
-sem_t *sem = NULL;
+LedShm::Ring *ring = nullptr;
 
 int createAndOpenShm(){
     // Shared memory
-    shm_fd = shm_open(SHM_NAME, O_RDWR | O_CREAT, SHM_MODE);
+    shm_fd = shm_open(LedShm::NAME, O_RDWR | O_CREAT, SHM_MODE);
     if(shm_fd == -1) return 1;
 
     if(ftruncate(shm_fd, SHM_SIZE) < 0) return 1;
@@ -37,197 +56,640 @@ int createAndOpenShm(){
     shm = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     if(shm == MAP_FAILED) return 1;
 
-    // Initialize intensity
-    uint16_t *intensity = (uint16_t*)((uint8_t*)(shm)+NUM_LEDS_TOTAL*3);
-    *intensity = INITIAL_INTENSITY;
-
-    // Semaphore
-    if (sem_unlink(SEM_NAME) != 0){
-        fprintf(stderr,
-            "createAndOpenShm: could not unlink old semaphore; "
-            "this is normal as previous executions of this program are "
-            "supposed to cleanup before exiting\n"
-        );
-    }
-
-    sem = sem_open(SEM_NAME, O_CREAT, 0777, 1);
-
-    if (sem == SEM_FAILED){
-        return 1;
-    }
+    // Initialize header, intensity and the ring of frames
+    LedShm::Ring::init(shm, NUM_LEDS_TOTAL, SHM_NUM_FRAMES, INITIAL_INTENSITY);
+    ring = new LedShm::Ring(shm, SHM_SIZE);
 
     return 0;
 }
 
 int closeAndDeleteShm(){
+    delete ring;
+    ring = nullptr;
+
     if(munmap((void*)shm, SHM_SIZE) != 0) return 1;
 
     if(close(shm_fd) != 0) return 1;
 
-    if(shm_unlink(SHM_NAME) != 0) return 1;
-
-    if (sem_destroy(sem) != 0) return 1;
-
-    if (sem_unlink(SEM_NAME) != 0) return 1;
+    if(shm_unlink(LedShm::NAME) != 0) return 1;
 
     return 0;
 }
 
-// Flatten array of LED color components
-// and write to shared memory
-int writeToShm(LedProcessor &ledProcessor){
-    sem_wait(sem);
-
-    uint8_t *shm_leds = (uint8_t*)shm;
-    ledProcessor.copy(shm_leds);
+uint64_t monotonicNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
 
-    sem_post(sem);
+// Publish the LED colours of all chains to shared memory in one step,
+// and wake up the readers; stamps the time of publication
+int writeToShm(const LedFrame &frame, LedShm::Timestamps &timestamps, uint64_t &number){
+    timestamps.published = monotonicNanos();
+    number = ring->publish(frame, timestamps);
+    ring->notify();
     return 0;
 }
 
-void ledPrint(){
-    uint8_t *leds = (uint8_t*)shm;
-
-    int i = 0;
-    int range = NUM_LEDS_WIDTH;
-    printf("Bottom: ");
-    for (; i < range; i++) printf("%02x%02x%02x ", leds[3*i], leds[3*i+1], leds[3*i+2]);
-    printf("\n");
-
-    printf("Left   :");
-    range += NUM_LEDS_HEIGHT;
-    for (; i < range; i++) printf("%02x%02x%02x ", leds[3*i], leds[3*i+1], leds[3*i+2]);
-    printf("\n");
-
-    printf("Top    :");
-    range += NUM_LEDS_WIDTH;
-    for (; i < range; i++) printf("%02x%02x%02x ", leds[3*i], leds[3*i+1], leds[3*i+2]);
-    printf("\n");
-
-    printf("Right  :");
-    range += NUM_LEDS_HEIGHT;
-    for (; i < range; i++) printf("%02x%02x%02x ", leds[3*i], leds[3*i+1], leds[3*i+2]);
+void ledPrint(const LedFrame &leds){
+    static const char *EDGE_NAMES[LedLayout::NUM_EDGES] = {
+        "Bottom: ",
+        "Left   :",
+        "Top    :",
+        "Right  :"
+    };
+    const uint8_t *r = leds.channel(LedFrame::R);
+    const uint8_t *g = leds.channel(LedFrame::G);
+    const uint8_t *b = leds.channel(LedFrame::B);
+
+    size_t chain = 0;
+    for (int i = 0; i < NUM_LEDS_TOTAL; i++){
+        const bool chainStart = (chain < LED_CHAIN_STARTS.size() && LED_CHAIN_STARTS[chain] == i);
+        if(chainStart) ++chain;
+        if(i == 0 || chainStart || LED_EDGES[i] != LED_EDGES[i-1]){
+            if(i != 0) printf("\n");
+            printf("%s", EDGE_NAMES[LED_EDGES[i]]);
+        }
+        printf("%02x%02x%02x ", r[i], g[i], b[i]);
+    }
     printf("\n\n");
 }
 
-void lock_forever(){
-    sem_t sem;
-    sem_init(&sem, 0, 0);
-    sem_wait(&sem);
-}
-
-class AlarmTask {
-public:
-    virtual void execute() = 0;
-};
-
 class UpdateShmAlarmTask : public AlarmTask {
 private:
-    LedProcessor &ledProcessor;
+    std::vector<std::unique_ptr<CaptureChain>> &chains;
+    RateGovernor &governor;
+    LatencyTracker &latency;
+    FrameScheduler *scheduler;
+    PerfProfiler *profiler;
+    LedFrame frame;
+    bool blanked;
+    bool print;
 public:
-    UpdateShmAlarmTask(LedProcessor &ledProcessor_):
-        ledProcessor(ledProcessor_)
+    UpdateShmAlarmTask(std::vector<std::unique_ptr<CaptureChain>> &chains_, RateGovernor &governor_, LatencyTracker &latency_):
+        chains(chains_),
+        governor(governor_),
+        latency(latency_),
+        scheduler(nullptr),
+        profiler(nullptr),
+        frame(NUM_LEDS_TOTAL),
+        blanked(false),
+        print(true)
     {}
 
-    virtual void execute(){
-        ledProcessor.update();
+    /**
+     * @brief Set the scheduler whose period the governor controls.
+     */
+    void setScheduler(FrameScheduler *scheduler_){ scheduler = scheduler_; }
+
+    /**
+     * @brief Set the profiler that counts the stages of each frame, if any.
+     */
+    void setProfiler(PerfProfiler *profiler_){ profiler = profiler_; }
 
-        if (writeToShm(ledProcessor) == 0){
-            ledPrint();
+    /**
+     * @brief Set whether the colours of every frame are printed to stdout.
+     */
+    void setPrint(bool print_){ print = print_; }
+
+    virtual void execute(){
+        // Capture every display before reducing any, so that the stages
+        // can be timed apart; chains on blanked displays turn their LEDs off
+        LedShm::Timestamps timestamps;
+        if(profiler) profiler->beginFrame();
+        timestamps.captureStart = monotonicNanos();
+        bool captured = false;
+        for(std::unique_ptr<CaptureChain> &chain: chains) captured |= chain->capture();
+        timestamps.captureEnd = monotonicNanos();
+        if(profiler) profiler->endStage(PerfProfiler::CAPTURE);
+
+        size_t offset = 0;
+        for(std::unique_ptr<CaptureChain> &chain: chains){
+            chain->reduce(frame, offset);
+            offset += chain->getNumLeds();
+        }
+        timestamps.reduceEnd = monotonicNanos();
+        if(profiler) profiler->endStage(PerfProfiler::REDUCE);
+
+        int64_t period;
+        uint64_t number;
+        if(!captured){
+            // Every display is blanked: turn the LEDs off once, then only
+            // check whether a display is back on
+            if(!blanked){
+                writeToShm(frame, timestamps, number);
+                blanked = true;
+            }
+            period = governor.updateBlanked();
         } else {
-            printf("Error writting to shared memory");
+            blanked = false;
+
+            if (writeToShm(frame, timestamps, number) == 0){
+                if(profiler){
+                    profiler->endStage(PerfProfiler::PUBLISH);
+                    profiler->endFrame(number);
+                }
+                latency.recordFrame(number, timestamps);
+                if(print) ledPrint(frame);
+            } else {
+                printf("Error writting to shared memory");
+            }
+            period = governor.update(frame);
         }
+
+        // The consumer reports on frames as it sends them to the LEDs
+        LedShm::Feedback feedback;
+        if(ring->readFeedback(feedback)) latency.recordFeedback(feedback);
+
+        if(scheduler) scheduler->setPeriod(period);
     }
 
     virtual ~UpdateShmAlarmTask(){}
 };
 
-void callbackSIGALRM(int sig, siginfo_t *info, void *ucontext){
-    AlarmTask *task = (AlarmTask*)info->si_value.sival_ptr;
-    if(task != nullptr) task->execute();
+// Block SIGINT, SIGTERM and SIGUSR1, so that threads created from now on
+// do not receive them and the main thread can wait for them with sigwait
+int blockSignals(sigset_t &set){
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR1);
+
+    if(pthread_sigmask(SIG_BLOCK, &set, NULL) != 0){ perror("pthread_sigmask"); return 1; }
+
+    return 0;
 }
 
-UpdateShmAlarmTask *updateShmAlarmTask = nullptr;
+void latencyPrint(const LatencyTracker &latency){
+    for(int i = 0; i < LatencyTracker::NUM_STAGES; ++i){
+        const LatencyTracker::Stage stage = LatencyTracker::Stage(i);
+        const LatencyHistogram::Snapshot s = latency.getSnapshot(stage);
+        fprintf(stderr,
+            "[SCREENREADER] latency %-7s %8llu frames, min %8.3f, mean %8.3f, p50 %8.3f, "
+            "p90 %8.3f, p99 %8.3f, p99.9 %8.3f, max %8.3f ms\n",
+            LatencyTracker::getStageName(stage),
+            (unsigned long long)s.count,
+            s.min / 1e6, s.mean / 1e6,
+            s.getPercentile(0.5  ) / 1e6,
+            s.getPercentile(0.9  ) / 1e6,
+            s.getPercentile(0.99 ) / 1e6,
+            s.getPercentile(0.999) / 1e6,
+            s.max / 1e6
+        );
+    }
+}
 
-int setupSIGALRM(LedProcessor &ledProcessor){
-    struct sigaction act;
-    act.sa_flags = SA_SIGINFO | SA_RESTART;
-    act.sa_sigaction = callbackSIGALRM;
-    
-    if(sigaction(SIGALRM, &act, NULL) != 0){ perror("sigaction alrm"); return 1; }
+void perfPrint(const PerfProfiler &profiler){
+    const PerfProfiler::Totals t = profiler.getTotals();
+    if(t.frames == 0) return;
+    for(int i = 0; i < PerfProfiler::NUM_STAGES; ++i){
+        const PerfProfiler::Stage stage = PerfProfiler::Stage(i);
+        std::string line;
+        for(int c = 0; c < PerfCounters::NUM_COUNTERS; ++c){
+            char value[64];
+            if(t.available[c]) snprintf(value, sizeof(value), "%.1f", double(t.counts[i][c]) / t.frames);
+            else               snprintf(value, sizeof(value), "n/a");
+            line += std::string(c ? ", " : "") + PerfCounters::getName(PerfCounters::Counter(c)) + " " + value;
+        }
+        fprintf(stderr, "[SCREENREADER] perf %-7s %8llu frames, per frame: %s\n",
+            PerfProfiler::getStageName(stage), (unsigned long long)t.frames, line.c_str());
+    }
+}
 
-    delete updateShmAlarmTask;
-    updateShmAlarmTask = new UpdateShmAlarmTask(ledProcessor);
+// Print latencies and, if profiling, performance counters
+void reportPrint(const LatencyTracker &latency, const PerfProfiler *profiler){
+    latencyPrint(latency);
+    if(profiler) perfPrint(*profiler);
+}
 
-    struct sigevent sev;
-    sev.sigev_notify = SIGEV_SIGNAL;
-    sev.sigev_signo = SIGALRM;
-    sev.sigev_value.sival_ptr = (void*)updateShmAlarmTask;
+// Options of one capture chain; --next starts a new chain, with the
+// options of the previous one
+struct ChainOptions {
+    std::string source = "x11";
+    std::string display;
+    int width = 1920;
+    int height = 1080;
+    SyntheticFrameSource::Pattern pattern = SyntheticFrameSource::GRADIENT;
+    std::string file;
+    PixelFormat fileFormat = ARGB8888;
+    // Trace file to record the captured regions to, if any
+    std::string record;
+    std::string layout;
+    CaptureChain::Options capture;
+};
 
-    timer_t timerid;
-    if(timer_create(CLOCK_REALTIME, &sev, &timerid) != 0){ perror("timer_create"); return 1; }
-    
-    struct itimerspec ts = {
-        { 0, 50*MILLIS_TO_NANOS },
-        { 0, 50*MILLIS_TO_NANOS }
-    };
+struct Options {
+    std::vector<ChainOptions> chains = std::vector<ChainOptions>(1);
+    // Threads reducing each frame, including the capture thread
+    int threads = 1;
+    FrameScheduler::Options scheduler;
+    RateGovernor::Options governor;
+    uint32_t ringFrames = LedShm::DEFAULT_NUM_FRAMES;
+    // Time between latency reports, or 0 to only report on SIGUSR1 and exit
+    int64_t latencyReportNanos = 0;
+    // File to write performance counters to, if any
+    std::string perf;
+    // Run frames back to back instead of on a schedule
+    bool unpaced = false;
+    // Do not print the colours of every frame; implied by unpaced
+    bool quiet = false;
+    // Frames to run unpaced, or 0 for every frame of the longest trace
+    // replayed, or until interrupted if there is none
+    uint64_t frames = 0;
+};
 
-    if(timer_settime(timerid, 0, &ts, NULL) != 0){ perror("timer_settime"); return 1; }
+void usage(const char *argv0){
+    fprintf(stderr,
+        "Usage: %s [chain options] [--next [chain options]]... [options]\n"
+        "Chain options, which apply to the current capture chain:\n"
+        "  --source x11|xcb|synthetic|file|trace\n"
+        "                               Where to read frames from (default: x11);\n"
+        "                               xcb needs a build with `make XCB=1`\n"
+        "  --display NAME               X display for x11 and xcb sources\n"
+        "                               (default: $DISPLAY)\n"
+        "  --size WIDTHxHEIGHT          Screen size for synthetic and file sources\n"
+        "  --pattern black|static|gradient|noise\n"
+        "                               Pattern for synthetic source (default: gradient)\n"
+        "  --file PATH                  Raw frames for file source, or trace for\n"
+        "                               trace source\n"
+        "  --file-format argb8888|abgr8888|rgb565|bgr565\n"
+        "                               Pixel format of the frames of the file\n"
+        "                               and synthetic sources; argb8888 is BGRA\n"
+        "                               in memory\n"
+        "                               (default: argb8888)\n"
+        "  --record PATH                Record the regions captured from the\n"
+        "                               source to a trace, for the trace source\n"
+        "                               to replay\n"
+        "  --layout PATH                LED layout file (default: 32x20 LEDs,\n"
+        "                               clockwise from the bottom-right corner)\n"
+        "  --reduction direct|sat       Average pixels directly, or through\n"
+        "                               summed-area tables (default: direct)\n"
+        "  --depth PX                   Capture at most PX pixels in from each edge\n"
+        "                               (default: as deep as the LED regions)\n"
+        "  --step N                     Capture only every Nth row (top and bottom)\n"
+        "                               or column (sides) across that depth\n"
+        "                               (default: 1)\n"
+        "  --linear                     Average colours in linear light rather\n"
+        "                               than on sRGB values\n"
+        "  --incremental                Only recompute LEDs whose regions changed\n"
+        "  --samples XxY                Reduce X sample regions along the top and\n"
+        "                               bottom and Y along the sides, and blend\n"
+        "                               the LEDs from them, for dense strips\n"
+        "                               (default: one region per LED)\n"
+        "  --interpolation linear|spline\n"
+        "                               How LEDs are blended from the samples\n"
+        "                               nearest to them (default: linear)\n"
+        "  --next                       Start another capture chain, e.g. for\n"
+        "                               another display and strip; it starts\n"
+        "                               with the options of the previous one\n"
+        "Options:\n"
+        "  --threads N                  Split the reduction across N threads\n"
+        "                               (default: 1)\n"
+        "  --kernel NAME                Force the scalar, sse2, avx2 or neon\n"
+        "                               reduction kernels (default: fastest)\n"
+        "  --period MS                  Time between frames (default: 50)\n"
+        "  --unpaced                    Run frames back to back on the main\n"
+        "                               thread, as fast as they are processed,\n"
+        "                               and report the frame rate\n"
+        "  --frames N                   Stop after N unpaced frames (default: one\n"
+        "                               pass over the longest trace replayed, or\n"
+        "                               until interrupted)\n"
+        "  --quiet                      Do not print the LED colours of every\n"
+        "                               frame to stdout; implied by --unpaced\n"
+        "  --min-period MS              Time between frames during fast motion\n"
+        "                               (default: 20)\n"
+        "  --idle-period MS             Time between frames while the screen is\n"
+        "                               still, black or blanked (default: 1000)\n"
+        "  --motion-threshold LEVELS    Average change of an LED channel per\n"
+        "                               period that counts as fast motion\n"
+        "                               (default: 4)\n"
+        "  --still-threshold LEVELS     Average change below which the screen\n"
+        "                               counts as still (default: 0.5)\n"
+        "  --black-level LEVEL          Brightest LED channel at which the\n"
+        "                               screen counts as black (default: 8)\n"
+        "  --idle-frames N              Still or black frames before going\n"
+        "                               idle (default: 20)\n"
+        "  --priority N                 Run the capture thread with SCHED_FIFO\n"
+        "                               priority N (1-99)\n"
+        "  --cpu N                      Pin the capture thread to CPU N\n"
+        "  --mlock                      Lock the process memory in RAM\n"
+        "  --ring N                     Number of frames kept in /shm_leds\n"
+        "                               (default: 8)\n"
+        "  --latency-report SECONDS     Print latency histograms this often;\n"
+        "                               they are also printed on SIGUSR1 and\n"
+        "                               on exit\n"
+        "  --perf PATH                  Count cycles, instructions, cache misses\n"
+        "                               and branch misses of the capture, reduce\n"
+        "                               and publish stages of every frame, and\n"
+        "                               write them to PATH as JSON lines; a\n"
+        "                               summary is printed with the latencies\n",
+        argv0
+    );
+}
 
-    return 0;
+double parseNumber(const std::string &arg, const std::string &val){
+    char *end;
+    const double d = strtod(val.c_str(), &end);
+    if(val.empty() || *end != '\0') throw std::invalid_argument("Invalid value '" + val + "' for " + arg);
+    return d;
 }
 
-void callbackSIGINT(int sig, siginfo_t *info, void *ucontext) {
-    fprintf(stderr, "SIGINT callback\n");
+Options parseOptions(int argc, char *argv[]){
+    Options opts;
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--help"){ usage(argv[0]); exit(0); }
+        if(arg == "--mlock"){ opts.scheduler.lockMemory = true; continue; }
+        if(arg == "--unpaced"){ opts.unpaced = true; continue; }
+        if(arg == "--quiet"){ opts.quiet = true; continue; }
+        if(arg == "--next"){ opts.chains.push_back(opts.chains.back()); continue; }
+        ChainOptions &chain = opts.chains.back();
+        if(arg == "--incremental"){ chain.capture.incremental = true; continue; }
+        if(arg == "--linear"){ chain.capture.linear = true; continue; }
+        if(i+1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+        const std::string val = argv[++i];
+        if(arg == "--source"){
+            chain.source = val;
+        } else if(arg == "--display"){
+            chain.display = val;
+        } else if(arg == "--size"){
+            if(sscanf(val.c_str(), "%dx%d", &chain.width, &chain.height) != 2)
+                throw std::invalid_argument("Invalid size '" + val + "'");
+        } else if(arg == "--pattern"){
+            chain.pattern = SyntheticFrameSource::parsePattern(val);
+        } else if(arg == "--file"){
+            chain.file = val;
+        } else if(arg == "--record"){
+            chain.record = val;
+        } else if(arg == "--file-format"){
+            chain.fileFormat = PixelFormats::parse(val);
+        } else if(arg == "--samples"){
+            LedProcessor::Sampling &sampling = chain.capture.sampling;
+            if(sscanf(val.c_str(), "%dx%d", &sampling.countX, &sampling.countY) != 2 || sampling.countX < 1 || sampling.countY < 1)
+                throw std::invalid_argument("Invalid sample counts '" + val + "'");
+        } else if(arg == "--interpolation"){
+            chain.capture.sampling.interpolation = LedProcessor::parseInterpolation(val);
+        } else if(arg == "--layout"){
+            chain.layout = val;
+        } else if(arg == "--period"){
+            opts.scheduler.periodNanos = int64_t(parseNumber(arg, val)*MILLIS_TO_NANOS);
+            if(opts.scheduler.periodNanos <= 0) throw std::invalid_argument("Period must be positive");
+        } else if(arg == "--min-period" || arg == "--idle-period"){
+            const int64_t period = int64_t(parseNumber(arg, val)*MILLIS_TO_NANOS);
+            if(period <= 0) throw std::invalid_argument("Period must be positive");
+            (arg == "--min-period" ? opts.governor.fastPeriodNanos : opts.governor.idlePeriodNanos) = period;
+        } else if(arg == "--motion-threshold"){
+            opts.governor.motionThreshold = parseNumber(arg, val);
+        } else if(arg == "--still-threshold"){
+            opts.governor.stillThreshold = parseNumber(arg, val);
+        } else if(arg == "--black-level"){
+            opts.governor.blackLevel = int(parseNumber(arg, val));
+        } else if(arg == "--idle-frames"){
+            opts.governor.idleFrames = int(parseNumber(arg, val));
+            if(opts.governor.idleFrames < 1) throw std::invalid_argument("Idle frames must be positive");
+        } else if(arg == "--priority"){
+            opts.scheduler.priority = int(parseNumber(arg, val));
+        } else if(arg == "--cpu"){
+            opts.scheduler.cpu = int(parseNumber(arg, val));
+        } else if(arg == "--ring"){
+            opts.ringFrames = uint32_t(parseNumber(arg, val));
+            if(opts.ringFrames < 2) throw std::invalid_argument("The ring needs at least 2 frames");
+        } else if(arg == "--perf"){
+            opts.perf = val;
+        } else if(arg == "--frames"){
+            opts.frames = uint64_t(parseNumber(arg, val));
+        } else if(arg == "--latency-report"){
+            opts.latencyReportNanos = int64_t(parseNumber(arg, val)*1e9);
+            if(opts.latencyReportNanos < 0) throw std::invalid_argument("Latency report period must not be negative");
+        } else if(arg == "--depth"){
+            chain.capture.depth = int(parseNumber(arg, val));
+            if(chain.capture.depth < 0) throw std::invalid_argument("Depth must not be negative");
+        } else if(arg == "--step"){
+            chain.capture.step = int(parseNumber(arg, val));
+            if(chain.capture.step < 1) throw std::invalid_argument("Step must be positive");
+        } else if(arg == "--threads"){
+            opts.threads = int(parseNumber(arg, val));
+            if(opts.threads < 1) throw std::invalid_argument("There must be at least one thread");
+        } else if(arg == "--kernel"){
+            Kernels::setImplementation(val);
+        } else if(arg == "--reduction"){
+            chain.capture.reduction = ScreenProcessor::parseMode(val);
+        } else {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
 
-    if(closeAndDeleteShm()) exit(1);
+    // The normal period is --period; keep the others on either side of it
+    RateGovernor::Options &governor = opts.governor;
+    governor.normalPeriodNanos = opts.scheduler.periodNanos;
+    governor.fastPeriodNanos = std::min(governor.fastPeriodNanos, governor.normalPeriodNanos);
+    governor.idlePeriodNanos = std::max(governor.idlePeriodNanos, governor.normalPeriodNanos);
+    if(governor.stillThreshold > governor.motionThreshold)
+        throw std::invalid_argument("The still threshold must not exceed the motion threshold");
 
-    delete updateShmAlarmTask;
-    updateShmAlarmTask = nullptr;
+    return opts;
+}
 
-    exit(0);
+FrameSource *createFrameSource(const ChainOptions &opts){
+    if(opts.source == "x11"){
+        return new X11ShmFrameSource(opts.display.empty() ? NULL : opts.display.c_str());
+    } else if(opts.source == "xcb"){
+#ifdef USE_XCB
+        return new XcbShmFrameSource(opts.display.empty() ? NULL : opts.display.c_str());
+#else
+        throw std::invalid_argument("Built without xcb support; rebuild with `make XCB=1`");
+#endif
+    } else if(opts.source == "synthetic"){
+        return new SyntheticFrameSource(opts.width, opts.height, opts.pattern, opts.fileFormat);
+    } else if(opts.source == "file"){
+        return new FileFrameSource(opts.file, opts.width, opts.height, opts.fileFormat);
+    } else if(opts.source == "trace"){
+        return new TraceFrameSource(opts.file);
+    } else {
+        throw std::invalid_argument("Unknown source '" + opts.source + "'");
+    }
 }
 
-int setupSIGINT(){
-    struct sigaction act;
-    act.sa_flags = SA_SIGINFO | SA_RESTART;
-    act.sa_sigaction = callbackSIGINT;
+// Run the task on the scheduler's thread, and report latencies on SIGUSR1
+// and, if asked, periodically, until told to quit
+void runScheduled(UpdateShmAlarmTask &task, const sigset_t &signals, const Options &opts, const LatencyTracker &latency, const PerfProfiler *profiler){
+    FrameScheduler scheduler(task, opts.scheduler);
+    task.setScheduler(&scheduler);
+    scheduler.start();
+
+    int sig;
+    while(true){
+        if(opts.latencyReportNanos > 0){
+            timespec timeout;
+            timeout.tv_sec  = opts.latencyReportNanos / 1000000000;
+            timeout.tv_nsec = opts.latencyReportNanos % 1000000000;
+            sig = sigtimedwait(&signals, NULL, &timeout);
+            if(sig < 0){
+                if(errno == EAGAIN) reportPrint(latency, profiler);
+                continue;
+            }
+        } else if(sigwait(&signals, &sig) != 0){
+            continue;
+        }
+        if(sig != SIGUSR1) break;
+        reportPrint(latency, profiler);
+    }
+    fprintf(stderr, "%s received\n", strsignal(sig));
+
+    scheduler.stop();
+    task.setScheduler(nullptr);
+
+    const FrameScheduler::Stats stats = scheduler.getStats();
+    fprintf(stderr,
+        "[SCREENREADER] %llu frames, %llu missed deadlines, %llu skipped frames, "
+        "%llu failed frames, longest frame %.3f ms\n",
+        (unsigned long long)stats.frames,
+        (unsigned long long)stats.missedDeadlines,
+        (unsigned long long)stats.skippedFrames,
+        (unsigned long long)stats.failedFrames,
+        stats.maxFrameNanos / 1e6
+    );
+}
 
-    if(sigaction(SIGINT, &act, NULL) != 0){ perror("sigaction int"); return 1; }
+// Run frames back to back on the main thread, as fast as they are
+// processed, until the given number of frames (if not 0) is done or a signal
+// to quit arrives; returns that signal, or 0. Replaying a trace, the frame
+// rate is compared to the one it was recorded at.
+int runUnpaced(AlarmTask &task, const sigset_t &signals, uint64_t frames, const LatencyTracker &latency, const PerfProfiler *profiler, const TraceFrameSource *trace){
+    const timespec poll = {0, 0};
+    const uint64_t start = monotonicNanos();
+    uint64_t done = 0;
+    int sig = 0;
+    while(frames == 0 || done < frames){
+        task.execute();
+        ++done;
+
+        sig = sigtimedwait(&signals, NULL, &poll);
+        if(sig == SIGUSR1) reportPrint(latency, profiler);
+        else if(sig > 0) break;
+        sig = 0;
+    }
+    const double seconds = (monotonicNanos() - start) / 1e9;
+    const double fps = done / seconds;
 
-    return 0;
+    fprintf(stderr, "[SCREENREADER] %llu unpaced frames in %.3f s, %.1f fps\n", (unsigned long long)done, seconds, fps);
+    if(trace && trace->getNumFrames() > 1 && trace->getDurationNanos() > 0){
+        const double recordedFps = (trace->getNumFrames() - 1) / (trace->getDurationNanos() / 1e9);
+        fprintf(stderr, "[SCREENREADER] %.1fx the recorded rate of %.1f fps\n", fps / recordedFps, recordedFps);
+    }
+    return sig;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    if(createAndOpenShm()) {
-        fprintf(stderr, "[SCREENREADER] Could not open shared memory");
+    Options opts;
+    try {
+        opts = parseOptions(argc, argv);
+    } catch(const std::invalid_argument &e){
+        fprintf(stderr, "[SCREENREADER] %s\n", e.what());
+        usage(argv[0]);
         return 1;
     }
 
-    ScreenReader screen(NUM_LEDS_WIDTH, NUM_LEDS_HEIGHT);
+    std::vector<std::unique_ptr<CaptureChain>> chains;
+    // Longest trace replayed, which sets the default length of an unpaced run
+    const TraceFrameSource *longestTrace = nullptr;
+    for(size_t i = 0; i < opts.chains.size(); ++i){
+        const ChainOptions &chainOpts = opts.chains[i];
+        const std::string prefix = (opts.chains.size() > 1 ? "Chain " + std::to_string(i+1) + ": " : "");
+
+        LedLayout layout;
+        if(!chainOpts.layout.empty()){
+            try {
+                layout = LedLayout::fromFile(chainOpts.layout);
+            } catch(const std::invalid_argument &e){
+                fprintf(stderr, "[SCREENREADER] %s%s\n", prefix.c_str(), e.what());
+                return 1;
+            }
+        }
 
-    const int PIXELS_PER_LED_AVG_X = screen.getScreenWidth () / NUM_LEDS_WIDTH;
-    const int PIXELS_PER_LED_AVG_Y = screen.getScreenHeight() / NUM_LEDS_HEIGHT;
-    ScreenProcessor screenProcessor(
-        screen,
-        PIXELS_PER_LED_AVG_X,
-        PIXELS_PER_LED_AVG_Y
-    );
+        FrameSource *source = nullptr;
+        try {
+            source = createFrameSource(chainOpts);
+
+            const TraceFrameSource *trace = dynamic_cast<const TraceFrameSource*>(source);
+            if(trace && (!longestTrace || trace->getNumFrames() > longestTrace->getNumFrames()))
+                longestTrace = trace;
 
-    LedProcessor ledProcessor(screenProcessor, NUM_LEDS_WIDTH, NUM_LEDS_HEIGHT);
+            if(!chainOpts.record.empty()) source = new TraceRecorder(source, chainOpts.record);
+        } catch(const std::exception &e){
+            fprintf(stderr, "[SCREENREADER] %sCould not create frame source: %s\n", prefix.c_str(), e.what());
+            return 1;
+        }
+
+        try {
+            chains.push_back(std::unique_ptr<CaptureChain>(new CaptureChain(source, layout, chainOpts.capture)));
+        } catch(const std::exception &e){
+            fprintf(stderr, "[SCREENREADER] %s%s\n", prefix.c_str(), e.what());
+            return 1;
+        }
+
+        LED_CHAIN_STARTS.push_back(LED_EDGES.size());
+        const std::vector<LedLayout::Edge> &edges = chains.back()->getEdges();
+        LED_EDGES.insert(LED_EDGES.end(), edges.begin(), edges.end());
+    }
+    NUM_LEDS_TOTAL = LED_EDGES.size();
+    SHM_NUM_FRAMES = opts.ringFrames;
+    SHM_SIZE = LedShm::getSize(NUM_LEDS_TOTAL, SHM_NUM_FRAMES);
 
-    if(setupSIGALRM(ledProcessor)){
-        fprintf(stderr, "[SCREENREADER] Could not setup SIGALRM");
+    if(createAndOpenShm()) {
+        fprintf(stderr, "[SCREENREADER] Could not open shared memory");
         return 1;
     }
 
-    if(setupSIGINT()){
-        fprintf(stderr, "[SCREENREADER] Could not setup SIGINT");
+    sigset_t signals;
+    if(blockSignals(signals)){
+        fprintf(stderr, "[SCREENREADER] Could not block signals");
         return 1;
     }
 
-    lock_forever();
+    // Workers are created after blocking signals, so they do not take them
+    WorkerPool pool(opts.threads);
+    for(std::unique_ptr<CaptureChain> &chain: chains) chain->setPool(&pool);
+
+    RateGovernor governor(NUM_LEDS_TOTAL, opts.governor);
+    LatencyTracker latency(SHM_NUM_FRAMES);
+    UpdateShmAlarmTask updateShmAlarmTask(chains, governor, latency);
+    std::unique_ptr<PerfProfiler> profiler;
+    if(!opts.perf.empty()){
+        try {
+            profiler.reset(new PerfProfiler(opts.perf));
+        } catch(const std::exception &e){
+            fprintf(stderr, "[SCREENREADER] %s\n", e.what());
+            return 1;
+        }
+        updateShmAlarmTask.setProfiler(profiler.get());
+    }
+    // Printing would dominate the time of unpaced frames
+    updateShmAlarmTask.setPrint(!opts.quiet && !opts.unpaced);
+
+    if(opts.unpaced){
+        const uint64_t frames = (opts.frames || !longestTrace ? opts.frames : longestTrace->getNumFrames());
+        const int sig = runUnpaced(updateShmAlarmTask, signals, frames, latency, profiler.get(), longestTrace);
+        if(sig > 0) fprintf(stderr, "%s received\n", strsignal(sig));
+    } else {
+        runScheduled(updateShmAlarmTask, signals, opts, latency, profiler.get());
+    }
+
+    const RateGovernor::Stats governorStats = governor.getStats();
+    fprintf(stderr,
+        "[SCREENREADER] %llu fast, %llu normal, %llu idle frames\n",
+        (unsigned long long)governorStats.frames[RateGovernor::FAST  ],
+        (unsigned long long)governorStats.frames[RateGovernor::NORMAL],
+        (unsigned long long)governorStats.frames[RateGovernor::IDLE  ]
+    );
+    reportPrint(latency, profiler.get());
+    if(profiler) profiler->writeTotals();
+
+    if(closeAndDeleteShm()){
+        fprintf(stderr, "[SCREENREADER] Could not close shared memory");
+        return 1;
+    }
 
     return 0;
 }
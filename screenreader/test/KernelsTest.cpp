@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "Kernels.h"
+#include "LinearLight.h"
+#include "PixelFormat.h"
+#include "ScreenProcessor.h"
+#include "ScreenReader.h"
+#include "SyntheticFrameSource.h"
+
+/*
+ * Checks that every pixel format decodes the strips of a SyntheticFrameSource
+ * to the colours it rendered, and that every reduction kernel this CPU
+ * supports adds up rows and averages regions exactly as the scalar one
+ * does. Exits with a non-zero status on the first failure.
+ */
+
+namespace {
+const char *IMPLEMENTATIONS[] = {"scalar", "sse2", "avx2", "neon"};
+
+struct Config {
+    int width, height;
+    int ledsX, ledsY;
+    int depth, step;
+};
+
+const Config CONFIGS[] = {
+    {1366,  768, 32, 20, 0, 1},
+    // An 800x480 panel, whose side strips are 25 pixels deep
+    { 800,  480, 32, 20, 0, 1},
+    // Odd sizes and depth
+    { 801,  479, 31, 19, 7, 1},
+    // The side strips as columns one pixel wide
+    {1366,  768, 32, 20, 0, 4},
+    { 999,  555, 17, 13, 9, 3},
+    {  65,   37,  4,  3, 0, 2},
+    // Rows long enough for every kernel to widen its sums more than once
+    {4096, 2160, 64, 36, 2, 1}
+};
+
+// Longest run summed at every start and length, besides whole lines
+const int MAX_RUN = 40;
+
+/**
+ * @brief Channel of 8 bits reduced to its top bits, and widened back as
+ * PixelTraits do.
+ */
+uint32_t quantize(uint32_t c, int bits){
+    const uint32_t v = c >> (8 - bits);
+    return (v << (8 - bits)) | (v >> (2*bits - 8));
+}
+
+/**
+ * @brief Colour a pixel rendered as argb has in format F: 8 bits per
+ * channel, or 5 for red and blue and 6 for green at 16 bits per pixel.
+ */
+template<PixelFormat F>
+uint32_t expectedARGB(uint32_t argb){
+    const bool wide = (PixelFormats::getBytesPerPixel(F) == 4);
+    return 0xff000000
+        | (quantize((argb >> 16) & 0xff, wide ? 8 : 5) << 16)
+        | (quantize((argb >>  8) & 0xff, wide ? 8 : 6) <<  8)
+        | (quantize((argb      ) & 0xff, wide ? 8 : 5)      );
+}
+
+template<PixelFormat F>
+void sumReference(const typename PixelTraits<F>::Pixel *row, int n, bool linear, uint32_t sums[3]){
+    for(int i = 0; i < n; ++i){
+        const uint32_t p = toARGB<F>(row[i]);
+        const uint32_t c[3] = {(p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff};
+        for(int k = 0; k < 3; ++k) sums[k] += (linear ? LinearLight::DECODE[c[k]] : c[k]);
+    }
+}
+
+bool checkSums(const char *what, const uint32_t expected[3], const uint32_t actual[3]){
+    for(int k = 0; k < 3; ++k){
+        if(expected[k] != actual[k]){
+            fprintf(stderr, "%s: channel %d sums to %u instead of %u\n", what, k, actual[k], expected[k]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Pixels of the strips against the ARGB8888 strips of the same
+ * pattern.
+ */
+template<PixelFormat F>
+bool checkDecoding(const char *name, const ScreenReader &reader, const ScreenReader &argb){
+    for(int s = 0; s < ScreenReader::NUM_STRIPS; ++s){
+        const StripSpan &span = reader.getStrip(ScreenReader::Strip(s));
+        const StripSpan &ref  = argb  .getStrip(ScreenReader::Strip(s));
+        for(int y = 0; y < span.height; ++y){
+            for(int x = 0; x < span.width; ++x){
+                const uint32_t expected = expectedARGB<F>(ref.row<ARGB8888>(y)[x]);
+                const uint32_t actual = toARGB<F>(span.row<F>(y)[x]);
+                if(expected != actual){
+                    fprintf(stderr, "%s: strip %d pixel (%d, %d) is %08x instead of %08x\n", name, s, x, y, actual, expected);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template<PixelFormat F>
+bool checkRun(const char *name, const typename PixelTraits<F>::Pixel *row, int n){
+    for(int linear = 0; linear < 2; ++linear){
+        uint32_t expected[3] = {0, 0, 0}, actual[3] = {0, 0, 0};
+        sumReference<F>(row, n, linear, expected);
+        if(linear) Kernels::sumRowLinearOf<F>(row, n, actual);
+        else       Kernels::sumRowOf      <F>(row, n, actual);
+        if(!checkSums(name, expected, actual)){
+            fprintf(stderr, "%s: run of %d pixels%s\n", name, n, linear ? ", in linear light" : "");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Row sums of the current kernels against pixel-by-pixel sums, over
+ * whole lines and over every short run.
+ */
+template<PixelFormat F>
+bool checkRows(const char *name, const ScreenReader &reader){
+    for(int s = 0; s < ScreenReader::NUM_STRIPS; ++s){
+        const StripSpan &span = reader.getStrip(ScreenReader::Strip(s));
+        for(int y = 0; y < span.height; ++y){
+            // Runs from a few offsets, so that vector loads are unaligned
+            for(int x0 = 0; x0 < std::min(4, span.width); ++x0){
+                const typename PixelTraits<F>::Pixel *row = span.row<F>(y) + x0;
+                const int rest = span.width - x0;
+                for(int n = 0; n <= std::min(MAX_RUN, rest); ++n){
+                    if(!checkRun<F>(name, row, n)) return false;
+                }
+                if(!checkRun<F>(name, row, rest)){
+                    fprintf(stderr, "%s: strip %d line %d from %d\n", name, s, y, x0);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Colour of the box of each LED, by every mode of ScreenProcessor.
+ */
+std::vector<uint32_t> getColors(ScreenReader &reader, const Config &config){
+    const int w = reader.getScreenWidth(), h = reader.getScreenHeight();
+    const int mx = reader.getMarginX(), my = reader.getMarginY();
+    std::vector<Rect> boxes;
+    for(int i = 0; i < config.ledsX; ++i){
+        const int x0 = w * i / config.ledsX, x1 = w * (i+1) / config.ledsX;
+        boxes.push_back(Rect(x0, 0   , x1-x0, my));
+        boxes.push_back(Rect(x0, h-my, x1-x0, my));
+    }
+    for(int i = 0; i < config.ledsY; ++i){
+        const int y0 = h * i / config.ledsY, y1 = h * (i+1) / config.ledsY;
+        boxes.push_back(Rect(0   , y0, mx, y1-y0));
+        boxes.push_back(Rect(w-mx, y0, mx, y1-y0));
+    }
+
+    std::vector<uint32_t> colors;
+    for(int mode = 0; mode < 2; ++mode){
+        for(int linear = 0; linear < 2; ++linear){
+            ScreenProcessor processor(reader, 1, 1, ScreenProcessor::Mode(mode), linear);
+            processor.updateTables();
+            for(const Rect &box: boxes){
+                const Color<uint8_t> c = processor.getColor(box);
+                colors.push_back((uint32_t(c.r) << 16) | (uint32_t(c.g) << 8) | c.b);
+            }
+        }
+    }
+    return colors;
+}
+
+template<PixelFormat F>
+bool checkFormat(){
+    const char *format = PixelFormats::getName(F);
+    for(const Config &config: CONFIGS){
+        char name[128];
+        snprintf(name, sizeof(name), "%s %dx%d, %dx%d LEDs, depth %d, step %d", format,
+            config.width, config.height, config.ledsX, config.ledsY, config.depth, config.step);
+
+        SyntheticFrameSource source(config.width, config.height, SyntheticFrameSource::NOISE, F);
+        SyntheticFrameSource argbSource(config.width, config.height, SyntheticFrameSource::NOISE);
+        ScreenReader reader(source, config.ledsX, config.ledsY, config.depth, config.step);
+        ScreenReader argb(argbSource, config.ledsX, config.ledsY, config.depth, config.step);
+        reader.update();
+        argb.update();
+        if(!checkDecoding<F>(name, reader, argb)) return false;
+
+        // Every kernel against pixel-by-pixel sums, and against the
+        // colours the scalar kernel gives
+        std::vector<uint32_t> scalarColors;
+        for(const char *implementation: IMPLEMENTATIONS){
+            try {
+                Kernels::setImplementation(implementation);
+            } catch(const std::invalid_argument &e){
+                continue;
+            }
+            char kernelName[160];
+            snprintf(kernelName, sizeof(kernelName), "%s, %s", name, implementation);
+            if(!checkRows<F>(kernelName, reader)) return false;
+
+            const std::vector<uint32_t> colors = getColors(reader, config);
+            if(scalarColors.empty()){
+                scalarColors = colors;
+            } else {
+                for(size_t i = 0; i < colors.size(); ++i){
+                    if(colors[i] != scalarColors[i]){
+                        fprintf(stderr, "%s: colour %zu is %06x instead of %06x\n", kernelName, i, colors[i], scalarColors[i]);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+}
+
+int main(){
+    if(!checkFormat<ARGB8888>()) return 1;
+    if(!checkFormat<ABGR8888>()) return 1;
+    if(!checkFormat<RGB565  >()) return 1;
+    if(!checkFormat<BGR565  >()) return 1;
+
+    printf("KernelsTest: OK\n");
+    return 0;
+}